@@ -10,12 +10,25 @@
 
 #include "AnalysisSettings.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <errno.h>
 #include <iomanip>
 #include <iostream>
 #include <stdexcept>
 
+static double convertToDouble(std::string varName, char *arg)
+{
+    char *end;
+    double retval = std::strtod(arg, &end);
+    if (end[0] || errno == ERANGE)
+    {
+        throw std::invalid_argument("Invalid value given for " + varName +
+                                    ": " + std::string(arg));
+    }
+    return retval;
+}
+
 static unsigned int convertToUint(std::string varName, char *arg)
 {
     char *end;
@@ -33,6 +46,17 @@ static unsigned int convertToUint(std::string varName, char *arg)
     return (unsigned int)retval;
 }
 
+// value of the optional argument argv[i], moving i to it
+static char *optionValue(int argc, char *argv[], int &i)
+{
+    if (i + 1 >= argc)
+    {
+        throw std::invalid_argument("Missing value for " +
+                                    std::string(argv[i]));
+    }
+    return argv[++i];
+}
+
 AnalysisSettings::AnalysisSettings(int argc, char *argv[], int rank, int nproc)
 : rank{rank}
 {
@@ -48,37 +72,215 @@ AnalysisSettings::AnalysisSettings(int argc, char *argv[], int rank, int nproc)
     npx = convertToUint("N", argv[3]);
     npy = convertToUint("M", argv[4]);
 
-    if (npx * npy != this->nproc)
+    for (int i = 5; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--gradient")
+        {
+            gradient = true;
+        }
+        else if (arg == "--rate")
+        {
+            rate = true;
+        }
+        else if (arg == "--stats")
+        {
+            stats = true;
+        }
+        else if (arg == "--bins")
+        {
+            bins = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--pipeline")
+        {
+            pipeline = true;
+        }
+        else if (arg == "--pipeline-steps")
+        {
+            pipelineSteps = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--step-timeout")
+        {
+            stepTimeout = convertToDouble(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--backoff-max")
+        {
+            backoffMax = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--decompose")
+        {
+            const std::string mode(optionValue(argc, argv, i));
+            if (mode == "even")
+                decompose = Decomposition::Even;
+            else if (mode == "blocks")
+                decompose = Decomposition::Blocks;
+            else
+                throw std::invalid_argument("Invalid value given for " + arg +
+                                            ": " + mode);
+        }
+        else if (arg == "--threads")
+        {
+            threads = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
+    }
+    if (threads < 1)
+    {
+        throw std::invalid_argument("--threads must be at least 1");
+    }
+    if (bins < 1)
+    {
+        throw std::invalid_argument("--bins must be at least 1");
+    }
+    if (backoffMax < 1)
+    {
+        throw std::invalid_argument("--backoff-max must be at least 1");
+    }
+    if (pipelineSteps < 3)
+    {
+        throw std::invalid_argument("--pipeline-steps must be at least 3");
+    }
+#ifndef _OPENMP
+    if (threads > 1)
+    {
+        throw std::invalid_argument(
+            "--threads needs heatAnalysis built with OpenMP");
+    }
+#endif
+
+    // N or M 0: the other one divides the processes, both 0: the grid is
+    // chosen in DecomposeArray
+    if (!npx && npy && this->nproc % npy == 0)
+    {
+        npx = this->nproc / npy;
+    }
+    else if (npx && !npy && this->nproc % npx == 0)
+    {
+        npy = this->nproc / npx;
+    }
+    if ((npx || npy) && npx * npy != (unsigned int)this->nproc)
     {
         throw std::invalid_argument("N*M must equal the number of processes");
     }
-    posx = rank % npx;
-    posy = rank / npx;
+    if (npx)
+    {
+        posx = rank % npx;
+        posy = rank / npx;
+    }
+}
+
+// Boundaries of p parts of n cells. The rest of the division is spread over
+// the first parts, one cell each, and a boundary is moved to the nearest of
+// the (sorted) cuts if that is at most a quarter of a part away, so a part
+// grows or shrinks by half of one at most.
+static std::vector<size_t> partition(size_t n, size_t p,
+                                     const std::vector<size_t> &cuts)
+{
+    std::vector<size_t> b(p + 1, n);
+    b[0] = 0;
+    const size_t tolerance = n / (4 * p);
+    for (size_t i = 1; i < p; ++i)
+    {
+        const size_t even = (n / p) * i + std::min(i, n % p);
+        size_t best = even;
+        size_t distance = tolerance + 1;
+        auto c = std::lower_bound(cuts.begin(), cuts.end(), even);
+        if (c != cuts.end() && *c - even < distance)
+        {
+            best = *c;
+            distance = *c - even;
+        }
+        if (c != cuts.begin() && even - *(c - 1) < distance)
+        {
+            best = *(c - 1);
+        }
+        b[i] = (best > b[i - 1] ? best : even);
+    }
+    return b;
+}
+
+// number of parts between the boundaries b that are not on a cut
+static size_t unaligned(const std::vector<size_t> &b,
+                        const std::vector<size_t> &cuts)
+{
+    size_t n = 0;
+    for (size_t i = 1; i + 1 < b.size(); ++i)
+    {
+        n += !std::binary_search(cuts.begin(), cuts.end(), b[i]);
+    }
+    return n;
 }
 
-void AnalysisSettings::DecomposeArray(int gndx, int gndy)
+void AnalysisSettings::DecomposeArray(int gndx, int gndy, int gndz,
+                                      const std::vector<size_t> &cutsx,
+                                      const std::vector<size_t> &cutsy)
 {
-    // 2D decomposition of global array reading
-    size_t ndx = gndx / npx;
-    size_t ndy = gndy / npy;
-    size_t offsx = ndx * posx;
-    size_t offsy = ndy * posy;
-    if (posx == npx - 1)
+    const bool aligned = (decompose == Decomposition::Blocks);
+    if (!npx)
     {
-        // right-most processes need to read all the rest of rows
-        ndx = gndx - ndx * (npx - 1);
+        // the grid of the processes with the fewest boundaries between
+        // writer blocks with --decompose blocks, then the smallest
+        // circumference of the blocks
+        const size_t n = static_cast<size_t>(nproc);
+        size_t best = 0;
+        double bestCost = 0.0;
+        for (size_t px = 1; px <= n; ++px)
+        {
+            if (n % px)
+            {
+                continue;
+            }
+            const size_t py = n / px;
+            double cost = double(gndx) / px + double(gndy) / py;
+            if (aligned)
+            {
+                cost += (unaligned(partition(gndx, px, cutsx), cutsx) +
+                         unaligned(partition(gndy, py, cutsy), cutsy)) *
+                        double(gndx + gndy);
+            }
+            if (!best || cost < bestCost)
+            {
+                best = px;
+                bestCost = cost;
+            }
+        }
+        npx = best;
+        npy = n / best;
+        posx = rank % npx;
+        posy = rank / npx;
     }
 
-    if (posy == npy - 1)
+    if (gndz > 0)
     {
-        // bottom processes need to read all the rest of columns
-        ndy = gndy - ndy * (npy - 1);
+        // a 3D array is read in columns of all planes
+        readsize.push_back(gndz);
+        offset.push_back(0);
     }
+    // 2D decomposition of global array reading: the blocks differ by one
+    // row (column) at most, or with --decompose blocks by half a block to
+    // end on the cuts between the blocks of the writer, so that a block is
+    // read as whole writer blocks
+    const std::vector<size_t> none;
+    const std::vector<size_t> bx = partition(gndx, npx, aligned ? cutsx : none);
+    const std::vector<size_t> by = partition(gndy, npy, aligned ? cutsy : none);
+    size_t ndx = bx[posx + 1] - bx[posx];
+    size_t ndy = by[posy + 1] - by[posy];
+    size_t offsx = bx[posx];
+    size_t offsy = by[posy];
     readsize.push_back(ndx);
     readsize.push_back(ndy);
     offset.push_back(offsx);
     offset.push_back(offsy);
 
-    std::cout << "rank " << rank << " reads 2D slice " << ndx << " x " << ndy
-              << " from offset (" << offsx << "," << offsy << ")" << std::endl;
+    if (gndz > 0)
+        std::cout << "rank " << rank << " reads 3D block " << gndz << " x "
+                  << ndx << " x " << ndy << " from offset (0," << offsx << ","
+                  << offsy << ")" << std::endl;
+    else
+        std::cout << "rank " << rank << " reads 2D slice " << ndx << " x "
+                  << ndy << " from offset (" << offsx << "," << offsy << ")"
+                  << std::endl;
 }
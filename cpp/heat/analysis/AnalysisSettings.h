@@ -14,6 +14,13 @@
 #include <string>
 #include <vector>
 
+// how the global array is divided among the processes
+enum class Decomposition
+{
+    Even,  // blocks of equal size, differing by one row or column at most
+    Blocks // blocks ending on the cuts between the blocks of the writer
+};
+
 class AnalysisSettings
 {
 
@@ -22,24 +29,41 @@ public:
     const std::string configfile = "adios2.xml";
     std::string inputfile;
     std::string outputfile;
-    unsigned int npx; // Number of processes in X (slow) dimension
-    unsigned int npy; // Number of processes in Y (fast) dimension
+    unsigned int npx; // Number of processes in X (slow) dimension, 0: any
+    unsigned int npy; // Number of processes in Y (fast) dimension, 0: any
+    Decomposition decompose = Decomposition::Even;
+    bool gradient = false;    // output the gradient magnitude of T
+    bool rate = false;        // output dT per simulation step
+    bool stats = false;       // output statistics instead of the fields
+    unsigned int bins = 64;   // bins of the histograms of --stats
+    unsigned int threads = 1; // OpenMP threads of Compute
+    bool pipeline = false;    // read, compute and write in their own threads
+    unsigned int pipelineSteps = 3; // step buffers of the pipeline
+    double stepTimeout = -1.0;      // seconds to wait for a step, < 0: ever
+    unsigned int backoffMax = 100;  // longest pause between polls in ms
 
     int rank;
     int nproc;
 
-    // Calculated in constructor
+    // Calculated in constructor, or in DecomposeArray if N and M are 0
     unsigned int posx; // Position of this process in X dimension
     unsigned int posy; // Position of this process in Y dimension
 
     // Calculated in DecomposeArray
     std::vector<size_t>
-        readsize; // Local array size in X-Y dimensions per process
+        readsize; // Local array size in (Z-)X-Y dimensions per process
     std::vector<size_t>
-        offset; // Offset of local array in X-Y dimensions on this process
+        offset; // Offset of local array in (Z-)X-Y dimensions on this process
 
     AnalysisSettings(int argc, char *argv[], int rank, int nproc);
-    void DecomposeArray(int gndx, int gndy);
+    // 2D decomposition of a gndx * gndy array, or of the X-Y dimensions of
+    // a gndz * gndx * gndy array for gndz > 0. With --decompose blocks,
+    // cutsx and cutsy are the sorted offsets where blocks of the writer
+    // start in X and Y, which the blocks of the processes end on where
+    // possible. If N and M are 0, the grid of the processes is chosen here.
+    void DecomposeArray(int gndx, int gndy, int gndz = 0,
+                        const std::vector<size_t> &cutsx = {},
+                        const std::vector<size_t> &cutsy = {});
 };
 
 #endif /* ANALYSISSETTINGS_H_ */
@@ -0,0 +1,220 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Sketch.cpp
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "Sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+Sketch::Sketch(size_t nbins, double lo, double hi) : m_data(Bins + nbins + 2)
+{
+    if (!nbins)
+    {
+        throw std::invalid_argument("A sketch needs at least 1 bin");
+    }
+    reset(lo, hi);
+}
+
+void Sketch::reset(double lo, double hi)
+{
+    std::fill(m_data.begin(), m_data.end(), 0.0);
+    m_data[Min] = std::numeric_limits<double>::infinity();
+    m_data[Max] = -std::numeric_limits<double>::infinity();
+    if (!(hi > lo))
+    {
+        hi = lo + std::max(std::abs(lo) * 1e-6, 1e-12);
+    }
+    m_data[Lo] = lo;
+    m_data[Hi] = hi;
+}
+
+void Sketch::add(const double *x, size_t rows, size_t length)
+{
+    if (!length)
+    {
+        return;
+    }
+    const size_t nbins = bins();
+    const double lo = m_data[Lo];
+    const double scale = nbins / (m_data[Hi] - lo);
+#pragma omp parallel
+    {
+        Sketch local(nbins, lo, m_data[Hi]);
+        double *h = local.m_data.data() + Bins;
+#pragma omp for schedule(static)
+        for (ptrdiff_t r = 0; r < (ptrdiff_t)rows; ++r)
+        {
+            const double *v = x + r * length;
+            // the moments of the row from the power sums of the distances
+            // to its first value, which are small enough not to cancel
+            const double k = v[0];
+            double s1 = 0.0, s2 = 0.0, s3 = 0.0, s4 = 0.0;
+            double vmin = k, vmax = k;
+#pragma omp simd reduction(+ : s1, s2, s3, s4) reduction(min : vmin)     \
+    reduction(max : vmax)
+            for (size_t j = 0; j < length; ++j)
+            {
+                const double d = v[j] - k;
+                const double d2 = d * d;
+                s1 += d;
+                s2 += d2;
+                s3 += d2 * d;
+                s4 += d2 * d2;
+                vmin = (v[j] < vmin ? v[j] : vmin);
+                vmax = (v[j] > vmax ? v[j] : vmax);
+            }
+            const double n = double(length);
+            const double m = s1 / n;
+            double row[Lo];
+            row[Count] = n;
+            row[Min] = vmin;
+            row[Max] = vmax;
+            row[Mean] = k + m;
+            row[M2] = s2 - n * m * m;
+            row[M3] = s3 - 3.0 * m * s2 + 2.0 * n * m * m * m;
+            row[M4] = s4 - 4.0 * m * s3 + 6.0 * m * m * s2 -
+                      3.0 * n * m * m * m * m;
+            merge(local.m_data.data(), row, 0);
+
+            for (size_t j = 0; j < length; ++j)
+            {
+                const double b = (v[j] - lo) * scale;
+                ++h[b < 0.0 ? 0 : (b >= nbins ? nbins + 1 : size_t(b) + 1)];
+            }
+        }
+#pragma omp critical
+        merge(m_data.data(), local.m_data.data(), nbins + 2);
+    }
+}
+
+void Sketch::merge(const Sketch &o)
+{
+    if (o.m_data.size() != m_data.size() || o.lo() != lo() || o.hi() != hi())
+    {
+        throw std::invalid_argument("Sketches over different bins");
+    }
+    merge(m_data.data(), o.m_data.data(), bins() + 2);
+}
+
+// the moments of the union of two sets of values from theirs, as in
+// P. Pebay, Formulas for robust, one-pass parallel computation of
+// covariances and arbitrary-order statistical moments, SAND2008-6212
+void Sketch::merge(double *a, const double *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        a[Bins + i] += b[Bins + i];
+    }
+    const double na = a[Count];
+    const double nb = b[Count];
+    if (nb == 0.0)
+    {
+        return;
+    }
+    if (na == 0.0)
+    {
+        std::copy(b, b + Lo, a);
+        return;
+    }
+    const double nab = na + nb;
+    const double d = b[Mean] - a[Mean];
+    const double d2 = d * d;
+    a[M4] += b[M4] +
+             d2 * d2 * na * nb * (na * na - na * nb + nb * nb) /
+                 (nab * nab * nab) +
+             6.0 * d2 * (na * na * b[M2] + nb * nb * a[M2]) / (nab * nab) +
+             4.0 * d * (na * b[M3] - nb * a[M3]) / nab;
+    a[M3] += b[M3] + d2 * d * na * nb * (na - nb) / (nab * nab) +
+             3.0 * d * (na * b[M2] - nb * a[M2]) / nab;
+    a[M2] += b[M2] + d2 * na * nb / nab;
+    a[Mean] += d * nb / nab;
+    a[Count] = nab;
+    a[Min] = std::min(a[Min], b[Min]);
+    a[Max] = std::max(a[Max], b[Max]);
+}
+
+void Sketch::mergeOp(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+    int bytes;
+    MPI_Type_size(*type, &bytes);
+    const size_t size = bytes / sizeof(double);
+    for (int i = 0; i < *len; ++i)
+    {
+        merge(static_cast<double *>(inout) + i * size,
+              static_cast<const double *>(in) + i * size, size - Bins);
+    }
+}
+
+void Sketch::reduce(MPI_Comm comm, int root)
+{
+    MPI_Datatype type;
+    MPI_Type_contiguous(int(m_data.size()), MPI_DOUBLE, &type);
+    MPI_Type_commit(&type);
+    MPI_Op op;
+    MPI_Op_create(&Sketch::mergeOp, 1, &op);
+    std::vector<double> global(m_data.size());
+    MPI_Reduce(m_data.data(), global.data(), 1, type, op, root, comm);
+    MPI_Op_free(&op);
+    MPI_Type_free(&type);
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank == root)
+    {
+        m_data = global;
+    }
+    MPI_Bcast(&m_data[Min], 2, MPI_DOUBLE, root, comm);
+}
+
+double Sketch::variance() const
+{
+    return (count() > 0.0 ? m_data[M2] / count() : 0.0);
+}
+
+double Sketch::skewness() const
+{
+    const double m2 = m_data[M2];
+    return (m2 > 0.0 ? std::sqrt(count()) * m_data[M3] / std::pow(m2, 1.5)
+                     : 0.0);
+}
+
+double Sketch::kurtosis() const
+{
+    const double m2 = m_data[M2];
+    return (m2 > 0.0 ? count() * m_data[M4] / (m2 * m2) - 3.0 : 0.0);
+}
+
+double Sketch::quantile(double q) const
+{
+    if (count() == 0.0)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    const size_t nbins = bins();
+    const double width = (hi() - lo()) / nbins;
+    const double target = q * count();
+    double below = 0.0;
+    for (size_t b = 0; b < nbins + 2; ++b)
+    {
+        const double c = m_data[Bins + b];
+        if (c > 0.0 && below + c >= target)
+        {
+            // the bin, within the values seen
+            const double left =
+                std::max(b == 0 ? min() : lo() + (b - 1) * width, min());
+            const double right =
+                std::min(b == nbins + 1 ? max() : lo() + b * width, max());
+            return left + (right - left) * std::max(target - below, 0.0) / c;
+        }
+        below += c;
+    }
+    return max();
+}
@@ -0,0 +1,79 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Sketch.h
+ *
+ * Mergeable summary of the values of a field: moments and a histogram of
+ * fixed bins, from which quantiles are estimated
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef SKETCH_H_
+#define SKETCH_H_
+
+#include <mpi.h>
+
+#include <cstddef>
+#include <vector>
+
+class Sketch
+{
+public:
+    // nbins bins of equal width over [lo, hi), and one bin each for the
+    // values below and above
+    explicit Sketch(size_t nbins = 64, double lo = 0.0, double hi = 1.0);
+
+    // forget all values and set the range of the bins; an empty range is
+    // widened so that the values equal to lo fall into the first bin
+    void reset(double lo, double hi);
+    // add the rows * length values of x, a row at a time in each thread
+    void add(const double *x, size_t rows, size_t length);
+    // add the values of the sketch o over the same bins
+    void merge(const Sketch &o);
+    // merge the sketches of all processes of comm into the one of root;
+    // min() and max() become the global ones on all processes, to set the
+    // range of the next step
+    void reduce(MPI_Comm comm, int root);
+
+    size_t bins() const { return m_data.size() - Bins - 2; };
+    double lo() const { return m_data[Lo]; };
+    double hi() const { return m_data[Hi]; };
+    double count() const { return m_data[Count]; };
+    double min() const { return m_data[Min]; };
+    double max() const { return m_data[Max]; };
+    double mean() const { return m_data[Mean]; };
+    double variance() const;
+    double skewness() const;
+    double kurtosis() const; // excess kurtosis, 0 for a normal distribution
+    // estimated value below which a fraction q of the values are, linear
+    // within a bin
+    double quantile(double q) const;
+    // count of values in bin b: below lo for b = 0, then the bins over
+    // [lo, hi), then above hi for b = bins() + 1
+    double histogram(size_t b) const { return m_data[Bins + b]; };
+
+private:
+    // the layout of m_data, also of the reduction of the sketch in MPI
+    enum Index
+    {
+        Count,
+        Min,
+        Max,
+        Mean,
+        M2, // sums of the 2nd to 4th power of the distance from the mean
+        M3,
+        M4,
+        Lo,
+        Hi,
+        Bins
+    };
+    std::vector<double> m_data;
+
+    // MPI_Op merging sketches of the contiguous type of their doubles
+    static void mergeOp(void *in, void *inout, int *len, MPI_Datatype *type);
+    static void merge(double *a, const double *b, size_t n);
+};
+
+#endif /* SKETCH_H_ */
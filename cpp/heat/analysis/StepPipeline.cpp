@@ -0,0 +1,187 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * StepPipeline.cpp
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "StepPipeline.h"
+
+#include <mpi.h>
+
+#include <stdexcept>
+#include <thread>
+
+StepPipeline::StepPipeline(size_t nbuffers, bool threaded)
+: m_nbuffers{nbuffers}, m_threaded{threaded}
+{
+    if (m_nbuffers < (threaded ? 3 : 2))
+    {
+        throw std::invalid_argument(
+            "StepPipeline needs 2 buffers, or 3 when threaded");
+    }
+}
+
+size_t StepPipeline::run(const ReadFunc &read, const ComputeFunc &compute,
+                         const WriteFunc &write)
+{
+    const double start = MPI_Wtime();
+    size_t n = 0;
+    if (!m_threaded)
+    {
+        while (true)
+        {
+            const size_t b = n % m_nbuffers;
+            double t = MPI_Wtime();
+            const bool more = read(b);
+            m_readTime += MPI_Wtime() - t;
+            if (!more)
+            {
+                break;
+            }
+            t = MPI_Wtime();
+            compute(b, n ? int((n - 1) % m_nbuffers) : -1);
+            m_computeTime += MPI_Wtime() - t;
+            t = MPI_Wtime();
+            write(b);
+            m_writeTime += MPI_Wtime() - t;
+            ++n;
+        }
+        m_totalTime += MPI_Wtime() - start;
+        return n;
+    }
+
+    m_read = m_computed = m_written = 0;
+    m_endOfInput = m_computeDone = false;
+    m_error = nullptr;
+    std::thread reader(&StepPipeline::readLoop, this, std::cref(read));
+    std::thread writer(&StepPipeline::writeLoop, this, std::cref(write));
+
+    // compute step n as soon as it is read
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_cond.wait(lock, [this, n] {
+            return m_read > n || m_endOfInput || m_error;
+        });
+        if (m_error || m_read == n)
+        {
+            break;
+        }
+        lock.unlock();
+        try
+        {
+            const double t = MPI_Wtime();
+            compute(n % m_nbuffers, n ? int((n - 1) % m_nbuffers) : -1);
+            m_computeTime += MPI_Wtime() - t;
+        }
+        catch (...)
+        {
+            fail();
+        }
+        lock.lock();
+        if (m_error)
+        {
+            break;
+        }
+        m_computed = ++n;
+        m_cond.notify_all();
+    }
+    m_computeDone = true;
+    m_cond.notify_all();
+    lock.unlock();
+
+    reader.join();
+    writer.join();
+    m_totalTime += MPI_Wtime() - start;
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+    return n;
+}
+
+void StepPipeline::readLoop(const ReadFunc &read)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (size_t r = 0;; ++r)
+    {
+        // the buffer of step r held step r-nbuffers, which is free once it
+        // is written and the step after it, which needs it as the previous
+        // step, is computed
+        m_cond.wait(lock, [this, r] {
+            return (m_written + m_nbuffers > r &&
+                    m_computed + m_nbuffers > r + 1) ||
+                   m_error;
+        });
+        if (m_error)
+        {
+            return;
+        }
+        lock.unlock();
+        bool more = false;
+        try
+        {
+            const double t = MPI_Wtime();
+            more = read(r % m_nbuffers);
+            m_readTime += MPI_Wtime() - t;
+        }
+        catch (...)
+        {
+            fail();
+            return;
+        }
+        lock.lock();
+        if (more)
+            ++m_read;
+        else
+            m_endOfInput = true;
+        m_cond.notify_all();
+        if (!more)
+        {
+            return;
+        }
+    }
+}
+
+void StepPipeline::writeLoop(const WriteFunc &write)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (size_t w = 0;; ++w)
+    {
+        m_cond.wait(lock, [this, w] {
+            return m_computed > w || m_computeDone || m_error;
+        });
+        if (m_error || m_computed == w)
+        {
+            return;
+        }
+        lock.unlock();
+        try
+        {
+            const double t = MPI_Wtime();
+            write(w % m_nbuffers);
+            m_writeTime += MPI_Wtime() - t;
+        }
+        catch (...)
+        {
+            fail();
+            return;
+        }
+        lock.lock();
+        ++m_written;
+        m_cond.notify_all();
+    }
+}
+
+void StepPipeline::fail()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_error)
+    {
+        m_error = std::current_exception();
+    }
+    m_cond.notify_all();
+}
@@ -0,0 +1,77 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * StepPipeline.h
+ *
+ * Read, compute and write the steps of a stream through a ring of step
+ * buffers, one stage after the other or overlapped on three threads
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef STEPPIPELINE_H_
+#define STEPPIPELINE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+class StepPipeline
+{
+public:
+    // read the next step into buffer b, false at the end of the input
+    typedef std::function<bool(size_t b)> ReadFunc;
+    // compute the step in buffer b, with the previous step in buffer p or
+    // p = -1 in the first step
+    typedef std::function<void(size_t b, int p)> ComputeFunc;
+    // write the step in buffer b
+    typedef std::function<void(size_t b)> WriteFunc;
+
+    // nbuffers step buffers. Serially each step is read, computed and
+    // written before the next one is read, which needs 2 buffers. Threaded,
+    // step N+1 is read and step N-1 is written by their own threads while
+    // the calling thread computes step N, which needs at least 3 buffers;
+    // more let the reader run further ahead of a slow writer.
+    StepPipeline(size_t nbuffers, bool threaded);
+    StepPipeline(const StepPipeline &) = delete;
+    StepPipeline &operator=(const StepPipeline &) = delete;
+
+    // process all steps of the input, return their number. An exception of
+    // a stage stops the others and is rethrown here.
+    size_t run(const ReadFunc &read, const ComputeFunc &compute,
+               const WriteFunc &write);
+
+    size_t buffers() const { return m_nbuffers; };
+    // seconds spent in each stage, and in run() altogether
+    double readTime() const { return m_readTime; };
+    double computeTime() const { return m_computeTime; };
+    double writeTime() const { return m_writeTime; };
+    double totalTime() const { return m_totalTime; };
+
+private:
+    const size_t m_nbuffers;
+    const bool m_threaded;
+    double m_readTime = 0.0;
+    double m_computeTime = 0.0;
+    double m_writeTime = 0.0;
+    double m_totalTime = 0.0;
+
+    // steps done by each stage so far; the buffer of step N is N % nbuffers
+    size_t m_read = 0;
+    size_t m_computed = 0;
+    size_t m_written = 0;
+    bool m_endOfInput = false;  // the reader found no more steps
+    bool m_computeDone = false; // all steps read are computed
+    std::exception_ptr m_error; // exception of a stage
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+
+    void readLoop(const ReadFunc &read);
+    void writeLoop(const WriteFunc &write);
+    void fail(); // record the current exception and wake up all stages
+};
+
+#endif /* STEPPIPELINE_H_ */
@@ -9,9 +9,13 @@
  *
  */
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "adios2.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
@@ -20,48 +24,244 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
-#include <chrono>
-#include <thread>
 
 #include "AnalysisSettings.h"
+#include "Sketch.h"
+#include "StepPipeline.h"
+#include "StepWaiter.h"
 
 void printUsage()
 {
-    std::cout << "Usage: heatAnalysis  input  output N  M \n"
+    std::cout << "Usage: heatAnalysis  input  output N  M  [options]\n"
               << "  input:   name of input data file/stream\n"
               << "  output:  name of output data file/stream\n"
               << "  N:       number of processes in X dimension\n"
-              << "  M:       number of processes in Y dimension\n\n";
+              << "  M:       number of processes in Y dimension\n"
+              << "           N and M can be 0 for a grid chosen for any number "
+                 "of processes\n"
+              << "Options:\n"
+              << "  --decompose even|blocks  blocks of equal size (default), "
+                 "or aligned to\n"
+              << "               the blocks of the writer where possible\n"
+              << "  --gradient   also output the gradient magnitude of T\n"
+              << "  --rate       also output dT per simulation step\n"
+              << "  --stats      output the moments, quantiles and histogram "
+                 "of each field\n"
+              << "               instead of the field\n"
+              << "  --bins n     bins of the histograms of --stats "
+                 "(default 64)\n"
+              << "  --threads n  OpenMP threads of each process "
+                 "(default 1)\n"
+              << "  --pipeline   read the next step and write the previous "
+                 "one in their own\n"
+              << "               threads while a step is computed\n"
+              << "  --pipeline-steps n  step buffers of --pipeline, at least "
+                 "3 (default 3)\n"
+              << "  --step-timeout s  stop if no step arrives in s seconds "
+                 "(default: wait forever)\n"
+              << "  --backoff-max ms  longest pause between polls for a step "
+                 "(at least 1, default 100)\n\n";
 }
 
-void Compute(const std::vector<double> &Tin, std::vector<double> &Tout,
-             std::vector<double> &dT, bool firstStep)
+/* The sorted offsets in dimension d where the blocks of the writer of v
+ * start in the current step, other than 0
+ */
+template <class T>
+std::vector<size_t> writerCuts(const adios2::Engine &reader,
+                               const adios2::Variable<T> &v, size_t d)
 {
-    /* Compute dT and
-     * copy Tin into Tout as it will be used for calculating dT in the
-     * next step
-     */
-    if (firstStep)
+    std::vector<size_t> cuts;
+    for (const auto &info : reader.BlocksInfo(v, reader.CurrentStep()))
     {
-        for (int i = 0; i < dT.size(); i++)
-        {
-            dT[i] = 0;
-            Tout[i] = Tin[i];
-        }
+        if (info.Start[d] > 0)
+            cuts.push_back(info.Start[d]);
     }
-    else
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    return cuts;
+}
+
+/* Buffers of one step of the analysis */
+struct StepBuffer
+{
+    std::vector<double> T;      // T as read, in double
+    std::vector<double> THalo;  // T with the halo of --gradient, as read
+    std::vector<float> TFloat;  // T of a simulation with float storage
+    bool isFloat = false;
+    size_t simStep = 0;         // simulation step of T
+    std::vector<double> dT;
+    std::vector<double> rate;
+    std::vector<double> gradient;
+    std::vector<Sketch> sketches; // of each output field with --stats
+};
+
+/* Variables of the statistics of a field with --stats */
+struct StatsVariables
+{
+    adios2::Variable<double> moments;
+    adios2::Variable<double> quantiles;
+    adios2::Variable<uint64_t> histogram;
+    adios2::Variable<double> range;
+};
+
+// the quantiles of the fields written with --stats
+static const std::vector<double> quantileLevels = {0.01, 0.05, 0.25, 0.5,
+                                                   0.75, 0.95, 0.99};
+
+/* Define the variables of the statistics of field name, nbins bins in the
+ * histogram, which the process of rank 0 writes
+ */
+StatsVariables defineStats(adios2::IO &io, const std::string &name,
+                           size_t nbins)
+{
+    StatsVariables v;
+    v.moments = io.DefineVariable<double>(name + "/moments", {7}, {0}, {7});
+    io.DefineAttribute<std::string>(
+        "description",
+        "number of cells, minimum, maximum, mean, variance, skewness and "
+        "excess kurtosis of " + name,
+        name + "/moments");
+    const size_t nq = quantileLevels.size();
+    v.quantiles =
+        io.DefineVariable<double>(name + "/quantiles", {nq}, {0}, {nq});
+    io.DefineAttribute<double>("levels", quantileLevels.data(), nq,
+                               name + "/quantiles");
+    io.DefineAttribute<std::string>(
+        "description",
+        "estimated values of " + name + " below which the fractions of the "
+        "cells in levels are",
+        name + "/quantiles");
+    v.histogram = io.DefineVariable<uint64_t>(name + "/histogram", {nbins + 2},
+                                              {0}, {nbins + 2});
+    io.DefineAttribute<std::string>(
+        "description",
+        "cells of " + name + " below range, in the bins of equal width over "
+        "range, and above range",
+        name + "/histogram");
+    v.range = io.DefineVariable<double>(name + "/range", {2}, {0}, {2});
+    io.DefineAttribute<std::string>(
+        "description",
+        "range of the bins of the histogram, the extent of " + name +
+            " in the previous step",
+        name + "/range");
+    return v;
+}
+
+/* Local block of the analysis: nz planes (1 in 2D) of nx rows of ny cells,
+ * read with hx0 rows before and hx1 rows after it, and hy0 and hy1 cells
+ * before and after each row (0 or 1, a halo for the gradient)
+ */
+struct Block
+{
+    size_t nz, nx, ny;
+    size_t hx0, hx1, hy0, hy1;
+};
+
+/* Compute the fields of a step in one pass over the rows of the block, from
+ * T as read with the halo of the block (in, double or float): T in double
+ * for the output (nothing to do if in is T already), dT = Tprev - T, and if
+ * they are not nullptr dT / steps into rate and the gradient magnitude of T
+ * into gradient. Each row is done by one thread in vectorized loops while
+ * it is in the cache. steps is the number of simulation steps since Tprev,
+ * 0 in the first step where dT and rate are 0. The gradient takes central
+ * differences, into the halo at the edges of the block, and one-sided ones
+ * at the edges of the global array, in units of cells.
+ */
+template <class In>
+void Compute(const In *in, const Block &b, double *T, const double *Tprev,
+             double *dT, double *rate, double *gradient, size_t steps)
+{
+    const ptrdiff_t nz = b.nz, nx = b.nx, ny = b.ny;
+    // rows and planes of in
+    const ptrdiff_t rowIn = ny + b.hy0 + b.hy1;
+    const ptrdiff_t planeIn = (nx + b.hx0 + b.hx1) * rowIn;
+    const double perStep = (steps ? 1.0 / steps : 0.0);
+#pragma omp parallel for schedule(static)
+    for (ptrdiff_t r = 0; r < nz * nx; ++r)
     {
-        for (int i = 0; i < dT.size(); i++)
+        const ptrdiff_t k = r / nx, i = r % nx;
+        const ptrdiff_t o = r * ny;
+        const In *t = in + k * planeIn + (i + b.hx0) * rowIn + b.hy0;
+        if ((const void *)in != (const void *)T)
+        {
+#pragma omp simd
+            for (ptrdiff_t j = 0; j < ny; ++j)
+                T[o + j] = t[j];
+        }
+
+        if (!steps)
         {
-            dT[i] = Tout[i] - Tin[i];
-            Tout[i] = Tin[i];
+            std::fill(dT + o, dT + o + ny, 0.0);
+            if (rate)
+                std::fill(rate + o, rate + o + ny, 0.0);
+        }
+        else if (rate)
+        {
+            const double *p = Tprev + o;
+#pragma omp simd
+            for (ptrdiff_t j = 0; j < ny; ++j)
+            {
+                const double d = p[j] - t[j];
+                dT[o + j] = d;
+                rate[o + j] = d * perStep;
+            }
+        }
+        else
+        {
+            const double *p = Tprev + o;
+#pragma omp simd
+            for (ptrdiff_t j = 0; j < ny; ++j)
+                dT[o + j] = p[j] - t[j];
+        }
+
+        if (gradient)
+        {
+            // neighbor rows and planes, the row itself at the edges of the
+            // global array (the block has all planes)
+            const bool hasUp = (i > 0 || b.hx0);
+            const bool hasDown = (i + 1 < nx || b.hx1);
+            const In *up = t - (hasUp ? rowIn : 0);
+            const In *down = t + (hasDown ? rowIn : 0);
+            const In *front = t - (k > 0 ? planeIn : 0);
+            const In *back = t + (k + 1 < nz ? planeIn : 0);
+            // a central difference spans two cells, a one-sided one
+            const double sx = (hasUp && hasDown ? 0.5 : 1.0);
+            const double sz = (back - front == 2 * planeIn ? 0.5 : 1.0);
+            double *g = gradient + o;
+#pragma omp simd
+            for (ptrdiff_t j = 1; j < ny - 1; ++j)
+            {
+                const double gx = sx * (double(down[j]) - up[j]);
+                const double gy = 0.5 * (double(t[j + 1]) - t[j - 1]);
+                const double gz = sz * (double(back[j]) - front[j]);
+                g[j] = sqrt(gx * gx + gy * gy + gz * gz);
+            }
+            // first and last cell of the row, one-sided in Y at the edges
+            // of the global array
+            for (ptrdiff_t j = 0; j < ny; j += std::max<ptrdiff_t>(ny - 1, 1))
+            {
+                const ptrdiff_t jl = (j > 0 || b.hy0 ? j - 1 : j);
+                const ptrdiff_t jr = (j + 1 < ny || b.hy1 ? j + 1 : j);
+                const double gx = sx * (double(down[j]) - up[j]);
+                const double sy = (jr - jl == 2 ? 0.5 : 1.0);
+                const double gy = sy * (double(t[jr]) - t[jl]);
+                const double gz = sz * (double(back[j]) - front[j]);
+                g[j] = sqrt(gx * gx + gy * gy + gz * gz);
+            }
         }
     }
 }
 
 int main(int argc, char *argv[])
 {
-    MPI_Init(&argc, &argv);
+    // only the main thread calls MPI, except for the reader and writer
+    // threads of --pipeline
+    const bool pipeline = std::find(argv + 1, argv + argc,
+                                    std::string("--pipeline")) != argv + argc;
+    int provided;
+    MPI_Init_thread(&argc, &argv,
+                    pipeline ? MPI_THREAD_MULTIPLE : MPI_THREAD_FUNNELED,
+                    &provided);
 
     /* When writer and reader is launched together with a single mpirun command,
        the world comm spans all applications. We have to split and create the
@@ -85,11 +285,44 @@ int main(int argc, char *argv[])
     try
     {
         AnalysisSettings settings(argc, argv, rank, nproc);
+#ifdef _OPENMP
+        omp_set_num_threads(settings.threads);
+#endif
+        // with --pipeline the output is written by another thread than the
+        // one reading the input, on its own communicator
+        MPI_Comm mpiWriterComm = mpiReaderComm;
+        if (settings.pipeline)
+        {
+            int provided;
+            MPI_Query_thread(&provided);
+            if (provided < MPI_THREAD_MULTIPLE)
+            {
+                throw std::runtime_error(
+                    "--pipeline needs MPI_THREAD_MULTIPLE from the MPI "
+                    "library");
+            }
+            MPI_Comm_dup(mpiReaderComm, &mpiWriterComm);
+        }
+        // the statistics are reduced in the computing thread
+        MPI_Comm mpiStatsComm = MPI_COMM_NULL;
+        if (settings.stats)
+        {
+            MPI_Comm_dup(mpiReaderComm, &mpiStatsComm);
+        }
         adios2::ADIOS ad(settings.configfile, mpiReaderComm, adios2::DebugON);
+        // ADIOS2 does not promise that the engines of one ADIOS object can
+        // be used from two threads, so the writer thread gets its own
+        std::unique_ptr<adios2::ADIOS> adWriter;
+        if (settings.pipeline)
+        {
+            adWriter.reset(new adios2::ADIOS(settings.configfile,
+                                             mpiWriterComm, adios2::DebugON));
+        }
 
         // Define IO method for engine creation
         adios2::IO inIO = ad.DeclareIO("SimulationOutput");
-        adios2::IO outIO = ad.DeclareIO("AnalysisOutput");
+        adios2::IO outIO =
+            (adWriter ? *adWriter : ad).DeclareIO("AnalysisOutput");
         if (!rank)
         {
 //            std::cout << "Using " << inIO.m_EngineType << " engine for input" << std::endl;
@@ -100,66 +333,158 @@ int main(int argc, char *argv[])
         adios2::Engine reader =
             inIO.Open(settings.inputfile, adios2::Mode::Read, mpiReaderComm);
 
-        std::vector<double> Tin;
-        std::vector<double> Tout;
-        std::vector<double> dT;
+        // a ring of step buffers: 2 for the current and the previous step,
+        // or --pipeline-steps to read and write other steps meanwhile
+        StepPipeline pipeline(settings.pipeline ? settings.pipelineSteps : 2,
+                              settings.pipeline);
+        std::vector<StepBuffer> buffers(pipeline.buffers());
         adios2::Variable<double> vTin;
-        adios2::Variable<double> vTout;
-        adios2::Variable<double> vdT;
+        adios2::Variable<float> vTinFloat;
+        // the fields computed and written, or summarized with --stats
+        std::vector<std::string> fields = {"T", "dT"};
+        if (settings.rate)
+            fields.push_back("rate");
+        if (settings.gradient)
+            fields.push_back("gradient");
+        auto fieldData = [&settings](const StepBuffer &buf) {
+            std::vector<const double *> data = {buf.T.data(), buf.dT.data()};
+            if (settings.rate)
+                data.push_back(buf.rate.data());
+            if (settings.gradient)
+                data.push_back(buf.gradient.data());
+            return data;
+        };
+        std::vector<adios2::Variable<double>> vFields;
+        std::vector<StatsVariables> vStats;
+        std::vector<double> moments, quantiles, ranges;
+        std::vector<uint64_t> histograms;
         adios2::Engine writer;
+        StepWaiter waiter(settings.stepTimeout, settings.backoffMax,
+                          mpiReaderComm);
+        Block block;
+        // the selection read, the block and the halo of --gradient
+        adios2::Dims readStart, readCount;
         bool firstStep = true;
         int step = 0;
 
-        while (true)
-        {
-            adios2::StepStatus status =
-                reader.BeginStep(adios2::StepMode::NextAvailable, 10.0f);
-            if (status == adios2::StepStatus::NotReady)
+        // read the next step into buffer b, false at the end of the stream
+        auto read = [&](size_t b) -> bool {
+            const adios2::StepStatus status = waiter.beginStep(reader);
+            if (status == adios2::StepStatus::NotReady && !rank)
             {
-                // std::cout << "Stream not ready yet. Waiting...\n";
-                std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-                continue;
+                std::cout << "No step within " << settings.stepTimeout
+                          << "s, stopping" << std::endl;
             }
-            else if (status != adios2::StepStatus::OK)
+            if (status != adios2::StepStatus::OK)
             {
-                break;
+                return false;
             }
 
             // Variable objects disappear between steps so we need this every
             // step
             vTin = inIO.InquireVariable<double>("T");
+            if (!vTin)
+            {
+                vTinFloat = inIO.InquireVariable<float>("T");
+                if (!vTinFloat)
+                {
+                    throw std::runtime_error("No variable T in " +
+                                             settings.inputfile);
+                }
+            }
 
             if (firstStep)
             {
-                unsigned int gndx = vTin.Shape()[0];
-                unsigned int gndy = vTin.Shape()[1];
+                const adios2::Dims shape =
+                    (vTin ? vTin.Shape() : vTinFloat.Shape());
+                // the simulation writes a 3D T with --3d, planes first
+                const bool threeD = (shape.size() == 3);
+                unsigned int gndz = (threeD ? shape[0] : 0);
+                unsigned int gndx = shape[threeD];
+                unsigned int gndy = shape[threeD + 1];
 
                 if (rank == 0)
                 {
+                    if (threeD)
+                        std::cout << "gndz       = " << gndz << std::endl;
                     std::cout << "gndx       = " << gndx << std::endl;
                     std::cout << "gndy       = " << gndy << std::endl;
                 }
 
-                settings.DecomposeArray(gndx, gndy);
-                Tin.resize(settings.readsize[0] * settings.readsize[1]);
-                Tout.resize(settings.readsize[0] * settings.readsize[1]);
-                dT.resize(settings.readsize[0] * settings.readsize[1]);
+                // with --decompose blocks the blocks of the processes are
+                // aligned to the blocks of the writer
+                std::vector<size_t> cutsx, cutsy;
+                if (settings.decompose == Decomposition::Blocks)
+                {
+                    cutsx = (vTin ? writerCuts(reader, vTin, threeD)
+                                  : writerCuts(reader, vTinFloat, threeD));
+                    cutsy = (vTin ? writerCuts(reader, vTin, threeD + 1)
+                                  : writerCuts(reader, vTinFloat, threeD + 1));
+                }
+                settings.DecomposeArray(gndx, gndy, gndz, cutsx, cutsy);
+                if (rank == 0)
+                {
+                    std::cout << "processes  = " << settings.npx << " x "
+                              << settings.npy << std::endl;
+                }
+                size_t n = 1;
+                for (const size_t c : settings.readsize)
+                    n *= c;
+                const std::vector<size_t> &c = settings.readsize;
+                block = {threeD ? c[0] : 1, c[threeD], c[threeD + 1],
+                         0, 0, 0, 0};
+                readStart = settings.offset;
+                readCount = settings.readsize;
+                if (settings.gradient)
+                {
+                    // one more row and column on each side within the
+                    // global array, so the gradient at the edges of the
+                    // block does not depend on the decomposition
+                    const size_t dx = threeD, dy = threeD + 1;
+                    block.hx0 = (readStart[dx] > 0);
+                    block.hx1 = (readStart[dx] + readCount[dx] < shape[dx]);
+                    block.hy0 = (readStart[dy] > 0);
+                    block.hy1 = (readStart[dy] + readCount[dy] < shape[dy]);
+                    readStart[dx] -= block.hx0;
+                    readStart[dy] -= block.hy0;
+                    readCount[dx] += block.hx0 + block.hx1;
+                    readCount[dy] += block.hy0 + block.hy1;
+                }
+                for (StepBuffer &buf : buffers)
+                {
+                    buf.T.resize(n);
+                    buf.dT.resize(n);
+                    if (settings.rate)
+                        buf.rate.resize(n);
+                    if (settings.gradient)
+                        buf.gradient.resize(n);
+                    if (settings.stats)
+                        buf.sketches.assign(fields.size(),
+                                            Sketch(settings.bins));
+                }
 
-                /* Create output variables and open output stream */
-                vTout = outIO.DefineVariable<double>(
-                    "T", {gndx, gndy}, settings.offset, settings.readsize);
-                vdT = outIO.DefineVariable<double>(
-                    "dT", {gndx, gndy}, settings.offset, settings.readsize);
-                writer = outIO.Open(settings.outputfile, adios2::Mode::Write,
-                                     mpiReaderComm);
-                outIO.LockDefinitions();
+                /* Create output variables, the output stream is opened by
+                 * the first write
+                 */
+                for (const std::string &name : fields)
+                {
+                    if (settings.stats)
+                        vStats.push_back(
+                            defineStats(outIO, name, settings.bins));
+                    else
+                        vFields.push_back(outIO.DefineVariable<double>(
+                            name, shape, settings.offset, settings.readsize));
+                }
 
                 MPI_Barrier(mpiReaderComm); // sync processes just for stdout
             }
 
             // Create a 2D selection for the subset
-            vTin.SetSelection(
-                adios2::Box<adios2::Dims>(settings.offset, settings.readsize));
+            const adios2::Box<adios2::Dims> selection(readStart, readCount);
+            if (vTin)
+                vTin.SetSelection(selection);
+            else
+                vTinFloat.SetSelection(selection);
 
             if (firstStep)
             {
@@ -168,34 +493,167 @@ int main(int argc, char *argv[])
 
             // Arrays are read by scheduling one or more of them
             // and performing the reads at once
-            reader.Get<double>(vTin, Tin.data());
-            /*printDataStep(Tin.data(), settings.readsize.data(),
+            StepBuffer &buf = buffers[b];
+            buf.isFloat = !vTin;
+            size_t nread = 1;
+            for (const size_t c : readCount)
+                nread *= c;
+            if (vTin && !settings.gradient)
+            {
+                reader.Get<double>(vTin, buf.T.data());
+            }
+            else if (vTin)
+            {
+                buf.THalo.resize(nread);
+                reader.Get<double>(vTin, buf.THalo.data());
+            }
+            else
+            {
+                buf.TFloat.resize(nread);
+                reader.Get<float>(vTinFloat, buf.TFloat.data());
+            }
+            /*printDataStep(buf.T.data(), settings.readsize.data(),
                           settings.offset.data(), rank, step); */
             reader.EndStep();
+            buf.simStep = reader.CurrentStep();
+            firstStep = false;
+            return true;
+        };
 
+        /* Compute dT and the other fields from the current T in buffer b
+         * and the previous T in buffer p; the analysis computes in double,
+         * a float T is converted in the same pass
+         */
+        auto compute = [&](size_t b, int p) {
+            StepBuffer &buf = buffers[b];
             if (!rank)
             {
                 std::cout << "Analysis step " << step
-                          << " processing simulation step "
-                          << reader.CurrentStep() << std::endl;
+                          << " processing simulation step " << buf.simStep
+                          << std::endl;
             }
+            const size_t steps = (p < 0 ? 0 : buf.simStep - buffers[p].simStep);
+            const double *Tprev = (p < 0 ? nullptr : buffers[p].T.data());
+            double *rate = (settings.rate ? buf.rate.data() : nullptr);
+            double *gradient =
+                (settings.gradient ? buf.gradient.data() : nullptr);
+            if (buf.isFloat)
+                Compute(buf.TFloat.data(), block, buf.T.data(), Tprev,
+                        buf.dT.data(), rate, gradient, steps);
+            else if (settings.gradient)
+                Compute(buf.THalo.data(), block, buf.T.data(), Tprev,
+                        buf.dT.data(), rate, gradient, steps);
+            else
+                Compute(buf.T.data(), block, buf.T.data(), Tprev,
+                        buf.dT.data(), rate, gradient, steps);
 
-            /* Compute dT from current T (Tin) and previous T (Tout)
-             * and save Tin in Tout for output and for future computation
-             */
-            Compute(Tin, Tout, dT, firstStep);
+            if (settings.stats)
+            {
+                // the bins span the extent of the field in the previous
+                // step, found in an extra pass in the first step or if the
+                // field was constant
+                const std::vector<const double *> data = fieldData(buf);
+                const size_t n = buf.T.size();
+                for (size_t k = 0; k < fields.size(); ++k)
+                {
+                    Sketch &sketch = buf.sketches[k];
+                    const Sketch *previous =
+                        (p < 0 ? nullptr : &buffers[p].sketches[k]);
+                    if (previous && previous->max() > previous->min())
+                    {
+                        sketch.reset(previous->min(), previous->max());
+                    }
+                    else
+                    {
+                        double extent[2] = {-HUGE_VAL, -HUGE_VAL};
+                        for (size_t i = 0; i < n; ++i)
+                        {
+                            extent[0] = std::max(extent[0], -data[k][i]);
+                            extent[1] = std::max(extent[1], data[k][i]);
+                        }
+                        MPI_Allreduce(MPI_IN_PLACE, extent, 2, MPI_DOUBLE,
+                                      MPI_MAX, mpiStatsComm);
+                        sketch.reset(-extent[0], extent[1]);
+                    }
+                    sketch.add(data[k], block.nz * block.nx, block.ny);
+                    sketch.reduce(mpiStatsComm, 0);
+                }
+            }
+            step++;
+        };
 
-            /* Output Tout and dT */
+        /* Output the fields of buffer b, or their statistics */
+        auto write = [&](size_t b) {
+            const StepBuffer &buf = buffers[b];
+            if (!writer)
+            {
+                writer = outIO.Open(settings.outputfile, adios2::Mode::Write,
+                                    mpiWriterComm);
+                outIO.LockDefinitions();
+            }
             writer.BeginStep();
-            writer.Put<double>(vTout, Tout.data());
-            writer.Put<double>(vdT, dT.data());
+            if (!settings.stats)
+            {
+                const std::vector<const double *> data = fieldData(buf);
+                for (size_t k = 0; k < fields.size(); ++k)
+                    writer.Put<double>(vFields[k], data[k]);
+            }
+            else if (!rank)
+            {
+                const size_t nq = quantileLevels.size();
+                const size_t nbins = settings.bins;
+                // kept until EndStep()
+                moments.resize(fields.size() * 7);
+                quantiles.resize(fields.size() * nq);
+                ranges.resize(fields.size() * 2);
+                histograms.resize(fields.size() * (nbins + 2));
+                for (size_t k = 0; k < fields.size(); ++k)
+                {
+                    const Sketch &sketch = buf.sketches[k];
+                    double *m = &moments[k * 7];
+                    m[0] = sketch.count();
+                    m[1] = sketch.min();
+                    m[2] = sketch.max();
+                    m[3] = sketch.mean();
+                    m[4] = sketch.variance();
+                    m[5] = sketch.skewness();
+                    m[6] = sketch.kurtosis();
+                    for (size_t q = 0; q < nq; ++q)
+                        quantiles[k * nq + q] =
+                            sketch.quantile(quantileLevels[q]);
+                    ranges[2 * k] = sketch.lo();
+                    ranges[2 * k + 1] = sketch.hi();
+                    for (size_t i = 0; i < nbins + 2; ++i)
+                        histograms[k * (nbins + 2) + i] =
+                            uint64_t(sketch.histogram(i));
+                    writer.Put<double>(vStats[k].moments, m);
+                    writer.Put<double>(vStats[k].quantiles, &quantiles[k * nq]);
+                    writer.Put<uint64_t>(vStats[k].histogram,
+                                         &histograms[k * (nbins + 2)]);
+                    writer.Put<double>(vStats[k].range, &ranges[2 * k]);
+                }
+            }
             writer.EndStep();
+        };
 
-            step++;
-            firstStep = false;
-        }
+        const size_t nsteps = pipeline.run(read, compute, write);
         reader.Close();
-        writer.Close();
+        if (writer)
+            writer.Close();
+        if (mpiWriterComm != mpiReaderComm)
+            MPI_Comm_free(&mpiWriterComm);
+        if (mpiStatsComm != MPI_COMM_NULL)
+            MPI_Comm_free(&mpiStatsComm);
+
+        if (!rank)
+        {
+            std::cout << "Analysis of " << nsteps << " steps in "
+                      << pipeline.totalTime() << "s: read "
+                      << pipeline.readTime() << "s, compute "
+                      << pipeline.computeTime() << "s, write "
+                      << pipeline.writeTime() << "s" << std::endl;
+            waiter.print(std::cout);
+        }
     }
     catch (std::invalid_argument &e) // command-line argument errors
     {
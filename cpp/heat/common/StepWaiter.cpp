@@ -0,0 +1,112 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * StepWaiter.cpp
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "StepWaiter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+StepWaiter::StepWaiter(double timeout, unsigned int backoffMax,
+                       MPI_Comm comm)
+: m_timeout{timeout}, m_backoffMax{backoffMax}, m_comm{comm}
+{
+    if (m_backoffMax < 1)
+    {
+        // a pause of 0 would poll the engine in a busy loop
+        throw std::invalid_argument("StepWaiter needs a backoff of 1 ms at "
+                                    "least");
+    }
+}
+
+adios2::StepStatus StepWaiter::beginStep(adios2::Engine &reader)
+{
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    auto elapsed = [start] {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+    unsigned int pause = 1; // milliseconds
+    while (true)
+    {
+        // the engine blocks until a step arrives, for the rest of the
+        // timeout or in slices of 10 s without one
+        const double left =
+            (m_timeout < 0 ? 10.0 : std::max(m_timeout - elapsed(), 0.0));
+        const adios2::StepStatus status = reader.BeginStep(
+            adios2::StepMode::NextAvailable, float(std::min(left, 10.0)));
+        const double waited = elapsed();
+        if (status == adios2::StepStatus::OK)
+        {
+            m_totalWait += waited;
+            m_maxWait = std::max(m_maxWait, waited);
+            // bin b > 0 holds waits of 2^(b-1) to 2^b ms
+            int bin = 0;
+            for (double ms = waited * 1000.0; ms >= 1.0 && bin < nbins - 1;
+                 ms /= 2.0)
+            {
+                ++bin;
+            }
+            ++m_histogram[bin];
+            ++m_steps;
+            return status;
+        }
+        if (status != adios2::StepStatus::NotReady)
+        {
+            return status;
+        }
+        ++m_retries;
+        if (m_timeout >= 0)
+        {
+            // BeginStep() is collective: the clocks of the processes differ,
+            // so they stop when one of them times out, or the others would
+            // wait for it in the next BeginStep()
+            int timedOut = (waited >= m_timeout);
+            MPI_Allreduce(MPI_IN_PLACE, &timedOut, 1, MPI_INT, MPI_MAX,
+                          m_comm);
+            if (timedOut)
+            {
+                return status;
+            }
+        }
+
+        // the engine did not block (long enough): back off before the next
+        // poll, without sleeping past the timeout
+        double sleep = pause / 1000.0;
+        if (m_timeout >= 0)
+        {
+            sleep = std::min(sleep, m_timeout - waited);
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+        pause = std::min(2 * pause, m_backoffMax);
+    }
+}
+
+void StepWaiter::print(std::ostream &out) const
+{
+    out << "Step wait: " << m_steps << " steps, mean "
+        << (m_steps ? m_totalWait / m_steps * 1000.0 : 0.0) << " ms, max "
+        << m_maxWait * 1000.0 << " ms, " << m_retries << " retries"
+        << std::endl;
+    for (int b = 0; b < nbins; ++b)
+    {
+        if (!m_histogram[b])
+        {
+            continue;
+        }
+        if (b == 0)
+            out << "  < 1 ms";
+        else if (b == nbins - 1)
+            out << "  >= " << (1u << (b - 1)) << " ms";
+        else
+            out << "  " << (1u << (b - 1)) << "-" << (1u << b) << " ms";
+        out << ": " << m_histogram[b] << std::endl;
+    }
+}
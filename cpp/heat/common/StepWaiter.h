@@ -0,0 +1,60 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * StepWaiter.h
+ *
+ * Step acquisition of the readers: wait for the next step of a stream,
+ * with exponential backoff between polls and a histogram of the waits
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef STEPWAITER_H_
+#define STEPWAITER_H_
+
+#include "adios2.h"
+
+#include <mpi.h>
+
+#include <cstddef>
+#include <ostream>
+
+class StepWaiter
+{
+public:
+    // Wait at most timeout seconds for a step, or forever if timeout < 0.
+    // Between polls of an engine that reports NotReady at once the pause
+    // starts at 1 ms and doubles up to backoffMax milliseconds, at least 1.
+    // All processes of comm, the communicator of the reader, give up
+    // together when the first of them times out.
+    StepWaiter(double timeout, unsigned int backoffMax, MPI_Comm comm);
+
+    // Begin the next step of reader: OK, EndOfStream or OtherError as
+    // BeginStep() returns them, or NotReady if no step arrived in time.
+    // The engine is asked to block until a step arrives, so the wait ends
+    // with the step where the engine supports it, and backs off otherwise.
+    adios2::StepStatus beginStep(adios2::Engine &reader);
+
+    // steps begun, and seconds waited for them in total and at most
+    size_t steps() const { return m_steps; };
+    double totalWait() const { return m_totalWait; };
+    double maxWait() const { return m_maxWait; };
+    // number of times the engine reported NotReady
+    size_t retries() const { return m_retries; };
+    // print the waits and their histogram in power of 2 milliseconds
+    void print(std::ostream &out) const;
+
+private:
+    static const int nbins = 16; // < 1 ms, < 2 ms, ..., >= 2^14 ms
+    const double m_timeout;
+    const unsigned int m_backoffMax;
+    const MPI_Comm m_comm;
+    size_t m_steps = 0;
+    size_t m_retries = 0;
+    double m_totalWait = 0.0;
+    double m_maxWait = 0.0;
+    size_t m_histogram[nbins] = {};
+};
+
+#endif /* STEPWAITER_H_ */
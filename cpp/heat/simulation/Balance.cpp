@@ -0,0 +1,225 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Balance.cpp
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "Balance.h"
+#include "HeatTransfer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+// the expected time of the slowest process has to drop by this fraction
+// for new blocks, so that noise in the measurement does not move arrays
+const double MinGain = 0.05;
+
+/* Split total cells into sizes inversely proportional to the cost of a
+ * cell at each position, at least minSize each, rounded by the largest
+ * remainders
+ */
+std::vector<unsigned int> Partition(const std::vector<double> &cost,
+                                    unsigned int total, unsigned int minSize)
+{
+    const size_t n = cost.size();
+    double speed = 0.0;
+    for (const double c : cost)
+        speed += 1.0 / c;
+    std::vector<double> share(n);
+    std::vector<unsigned int> sizes(n);
+    long rest = total;
+    for (size_t k = 0; k < n; ++k)
+    {
+        share[k] = total / cost[k] / speed;
+        sizes[k] = std::max<unsigned int>(minSize, std::floor(share[k]));
+        rest -= sizes[k];
+    }
+    for (; rest > 0; --rest)
+    {
+        size_t best = 0;
+        for (size_t k = 1; k < n; ++k)
+            if (share[k] - sizes[k] > share[best] - sizes[best])
+                best = k;
+        ++sizes[best];
+    }
+    for (; rest < 0; ++rest)
+    {
+        // the minimum size took more than the shares
+        size_t best = n;
+        for (size_t k = 0; k < n; ++k)
+            if (sizes[k] > minSize &&
+                (best == n || sizes[k] - share[k] > sizes[best] - share[best]))
+                best = k;
+        --sizes[best];
+    }
+    return sizes;
+}
+
+// offsets of blocks of the given sizes, with the total at the end
+std::vector<unsigned int> Offsets(const std::vector<unsigned int> &sizes)
+{
+    std::vector<unsigned int> offsets(sizes.size() + 1, 0);
+    for (size_t k = 0; k < sizes.size(); ++k)
+        offsets[k + 1] = offsets[k] + sizes[k];
+    return offsets;
+}
+
+/* The rows [i0,i1) and columns [j0,j1) two blocks have in common, given
+ * by their offsets at positions a and b
+ * @return false if they have no cells in common
+ */
+bool Overlap(const std::vector<unsigned int> &ax,
+             const std::vector<unsigned int> &ay, int apx, int apy,
+             const std::vector<unsigned int> &bx,
+             const std::vector<unsigned int> &by, int bpx, int bpy,
+             unsigned int &i0, unsigned int &i1, unsigned int &j0,
+             unsigned int &j1)
+{
+    i0 = std::max(ax[apx], bx[bpx]);
+    i1 = std::min(ax[apx + 1], bx[bpx + 1]);
+    j0 = std::max(ay[apy], by[bpy]);
+    j1 = std::min(ay[apy + 1], by[bpy + 1]);
+    return i0 < i1 && j0 < j1;
+}
+
+} // end anonymous namespace
+
+Balancer::Balancer(const Settings &s, MPI_Comm comm)
+: m_comm{comm}, m_positions(2 * s.nproc), m_blockx{s.blockx},
+  m_blocky{s.blocky}
+{
+    const int pos[2] = {(int)s.posx, (int)s.posy};
+    MPI_Allgather(pos, 2, MPI_INT, m_positions.data(), 2, MPI_INT, comm);
+}
+
+bool Balancer::plan(const Settings &s, double seconds)
+{
+    // seconds per cell of every process
+    const size_t nproc = m_positions.size() / 2;
+    std::vector<double> cost(nproc);
+    double c = seconds / ((double)s.ndx * s.ndy);
+    MPI_Allgather(&c, 1, MPI_DOUBLE, cost.data(), 1, MPI_DOUBLE, m_comm);
+    if (*std::min_element(cost.begin(), cost.end()) <= 0.0)
+    {
+        // no sweeps since the last plan
+        return false;
+    }
+
+    // expected time of the slowest process over the mean time
+    const auto slowest = [&](const std::vector<unsigned int> &bx,
+                             const std::vector<unsigned int> &by,
+                             double &imbalance) {
+        double max = 0.0, sum = 0.0;
+        for (size_t r = 0; r < nproc; ++r)
+        {
+            const double t = bx[m_positions[2 * r]] *
+                             (double)by[m_positions[2 * r + 1]] * cost[r];
+            max = std::max(max, t);
+            sum += t;
+        }
+        imbalance = max / (sum / nproc);
+        return max;
+    };
+
+    std::vector<double> rowCost(s.npx, 0.0);
+    for (size_t r = 0; r < nproc; ++r)
+    {
+        double &w = rowCost[m_positions[2 * r]];
+        w = std::max(w, s.blocky[m_positions[2 * r + 1]] * cost[r]);
+    }
+    m_blockx = Partition(rowCost, s.gndx, s.tblock);
+    std::vector<double> columnCost(s.npy, 0.0);
+    for (size_t r = 0; r < nproc; ++r)
+    {
+        double &w = columnCost[m_positions[2 * r + 1]];
+        w = std::max(w, m_blockx[m_positions[2 * r]] * cost[r]);
+    }
+    m_blocky = Partition(columnCost, s.gndy, s.tblock);
+
+    const double before = slowest(s.blockx, s.blocky, m_imbalance);
+    const double after = slowest(m_blockx, m_blocky, m_plannedImbalance);
+    return after < (1.0 - MinGain) * before;
+}
+
+template <class Real>
+std::vector<Real> Balancer::migrate(const Settings &s,
+                                    const std::vector<Real> &block) const
+{
+    const std::vector<unsigned int> fromX = Offsets(s.blockx);
+    const std::vector<unsigned int> fromY = Offsets(s.blocky);
+    const std::vector<unsigned int> toX = Offsets(m_blockx);
+    const std::vector<unsigned int> toY = Offsets(m_blocky);
+    const int px = s.posx;
+    const int py = s.posy;
+    const size_t nproc = m_positions.size() / 2;
+    const MPI_Datatype type = MpiType<Real>::value();
+    unsigned int i0, i1, j0, j1;
+
+    // the cells of the old block that fall into the new block of each
+    // process, row by row
+    std::vector<int> sendCounts(nproc), sendDispls(nproc);
+    std::vector<Real> send;
+    send.reserve(block.size());
+    for (size_t r = 0; r < nproc; ++r)
+    {
+        sendDispls[r] = send.size();
+        if (Overlap(fromX, fromY, px, py, toX, toY, m_positions[2 * r],
+                    m_positions[2 * r + 1], i0, i1, j0, j1))
+        {
+            for (unsigned int i = i0; i < i1; ++i)
+            {
+                const Real *t =
+                    &block[(i - fromX[px]) * s.ndy + j0 - fromY[py]];
+                send.insert(send.end(), t, t + (j1 - j0));
+            }
+        }
+        sendCounts[r] = send.size() - sendDispls[r];
+    }
+
+    // the cells of the new block from the old block of each process
+    std::vector<int> recvCounts(nproc), recvDispls(nproc);
+    int n = 0;
+    for (size_t r = 0; r < nproc; ++r)
+    {
+        recvDispls[r] = n;
+        recvCounts[r] = 0;
+        if (Overlap(fromX, fromY, m_positions[2 * r], m_positions[2 * r + 1],
+                    toX, toY, px, py, i0, i1, j0, j1))
+            recvCounts[r] = (i1 - i0) * (j1 - j0);
+        n += recvCounts[r];
+    }
+    std::vector<Real> recv(n);
+    MPI_Alltoallv(send.data(), sendCounts.data(), sendDispls.data(), type,
+                  recv.data(), recvCounts.data(), recvDispls.data(), type,
+                  m_comm);
+
+    const unsigned int ny = m_blocky[py];
+    std::vector<Real> result((size_t)m_blockx[px] * ny);
+    for (size_t r = 0; r < nproc; ++r)
+    {
+        if (!Overlap(fromX, fromY, m_positions[2 * r], m_positions[2 * r + 1],
+                     toX, toY, px, py, i0, i1, j0, j1))
+            continue;
+        const Real *t = &recv[recvDispls[r]];
+        for (unsigned int i = i0; i < i1; ++i, t += j1 - j0)
+        {
+            std::memcpy(&result[(i - toX[px]) * ny + j0 - toY[py]], t,
+                        (j1 - j0) * sizeof(Real));
+        }
+    }
+    return result;
+}
+
+template std::vector<double>
+Balancer::migrate<double>(const Settings &s,
+                          const std::vector<double> &block) const;
+template std::vector<float>
+Balancer::migrate<float>(const Settings &s,
+                         const std::vector<float> &block) const;
@@ -0,0 +1,60 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Balance.h
+ *
+ * Dynamic load balancing (--rebalance): the blocks of the processes are
+ * resized to the speed each process showed in the last steps, and the
+ * local arrays are moved to the new blocks
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef BALANCE_H_
+#define BALANCE_H_
+
+#include <mpi.h>
+
+#include <vector>
+
+#include "Settings.h"
+
+class Balancer
+{
+public:
+    Balancer(const Settings &s, MPI_Comm comm);
+
+    // Plan new blocks from the seconds this process spent in the sweeps
+    // over its block of s since the last plan(). The processes at one
+    // position in X share their rows, those at one position in Y their
+    // columns, so the rows are split first by the slowest process of each
+    // position in X, then the columns with the new rows. Collective.
+    // @return true if the planned blocks cut the expected time of the
+    // slowest process enough to be worth moving the arrays
+    bool plan(const Settings &s, double seconds);
+    // the planned block sizes, for Settings::Resize()
+    const std::vector<unsigned int> &blockx() const { return m_blockx; };
+    const std::vector<unsigned int> &blocky() const { return m_blocky; };
+    // time of the slowest process over the mean time in the last plan(),
+    // measured with the blocks of s and expected with the planned ones
+    double imbalance() const { return m_imbalance; };
+    double plannedImbalance() const { return m_plannedImbalance; };
+
+    // Move block, the ndx*ndy cells of this process in the blocks of s,
+    // to the planned blocks. Collective.
+    // @return the cells of this process in the planned blocks
+    template <class Real>
+    std::vector<Real> migrate(const Settings &s,
+                              const std::vector<Real> &block) const;
+
+private:
+    MPI_Comm m_comm;
+    std::vector<int> m_positions; // posx, posy of every process
+    std::vector<unsigned int> m_blockx;
+    std::vector<unsigned int> m_blocky;
+    double m_imbalance = 1.0;
+    double m_plannedImbalance = 1.0;
+};
+
+#endif /* BALANCE_H_ */
@@ -0,0 +1,52 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Convergence.cpp
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "Convergence.h"
+
+#include <cmath>
+
+Convergence::Convergence(const Settings &s, MPI_Comm comm)
+: m_s{s}, m_comm{comm}, m_active{s.tolerance > 0}, m_next{s.checkEvery}
+{
+}
+
+Convergence::~Convergence() { finish(); }
+
+void Convergence::finish()
+{
+    if (m_request == MPI_REQUEST_NULL)
+    {
+        return;
+    }
+    MPI_Wait(&m_request, MPI_STATUS_IGNORE);
+    m_residual = (m_s.residualL2 ? std::sqrt(m_global) : m_global);
+    m_iteration = m_pendingIteration;
+    if (m_residual < m_s.tolerance)
+    {
+        m_converged = true;
+        m_active = false;
+    }
+}
+
+bool Convergence::check(const StencilStats &stats, unsigned long iteration)
+{
+    finish();
+    if (m_converged)
+    {
+        return true;
+    }
+
+    // the change of the last sweep, computed by the stencil kernel
+    m_local = (m_s.residualL2 ? stats.change2 : stats.changeMax);
+    m_pendingIteration = iteration;
+    MPI_Iallreduce(&m_local, &m_global, 1, MPI_DOUBLE,
+                   m_s.residualL2 ? MPI_SUM : MPI_MAX, m_comm, &m_request);
+    m_next = iteration + m_s.checkEvery;
+    return false;
+}
@@ -0,0 +1,63 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Convergence.h
+ *
+ * Residual of the Jacobi iteration over all processes, reduced in the
+ * background while the iteration continues
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef CONVERGENCE_H_
+#define CONVERGENCE_H_
+
+#include <mpi.h>
+
+#include "Settings.h"
+#include "Stencil.h"
+
+class Convergence
+{
+public:
+    Convergence(const Settings &s, MPI_Comm comm);
+    ~Convergence();
+    Convergence(const Convergence &) = delete;
+    Convergence &operator=(const Convergence &) = delete;
+
+    // true if the iterations up to this one (counted over the whole run)
+    // end with a check, so their last sweep has to compute ht.stats()
+    bool due(unsigned long iteration) const
+    {
+        return m_active && iteration >= m_next;
+    };
+    // Start the reduction of the residual in stats (the ht.stats() of this
+    // iteration), after finishing the one of the previous check, which has
+    // had a whole check interval to complete. The same iterations are checked on all
+    // processes, so they all see convergence at the same one.
+    // @return true if the previous check was below the tolerance
+    bool check(const StencilStats &stats, unsigned long iteration);
+    // true once a check was below the tolerance
+    bool converged() const { return m_converged; };
+    // residual of the last finished check and its iteration
+    double residual() const { return m_residual; };
+    unsigned long iteration() const { return m_iteration; };
+
+private:
+    const Settings &m_s;
+    MPI_Comm m_comm;
+    bool m_active; // a tolerance was given and it is not converged yet
+    bool m_converged = false;
+    unsigned long m_next;                  // iteration of the next check
+    MPI_Request m_request = MPI_REQUEST_NULL;
+    double m_local;                        // residual being reduced
+    double m_global;                       // its result
+    unsigned long m_pendingIteration = 0;  // iteration being reduced
+    double m_residual = -1.0;
+    unsigned long m_iteration = 0;
+
+    void finish(); // wait for the reduction in flight
+};
+
+#endif /* CONVERGENCE_H_ */
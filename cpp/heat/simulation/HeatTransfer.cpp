@@ -11,6 +11,9 @@
  *
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iomanip>
 #include <iostream>
 #include <math.h>
@@ -20,86 +23,444 @@
 
 #include "HeatTransfer.h"
 
-HeatTransfer::HeatTransfer(const Settings &settings) : m_s{settings}
+template <class Real>
+HeatTransfer<Real>::HeatTransfer(const Settings &settings, MPI_Comm comm)
+: m_s{settings}
 {
-    m_T1 = new double *[m_s.ndx + 2];
-    m_T1[0] = new double[(m_s.ndx + 2) * (m_s.ndy + 2)];
-    m_T2 = new double *[m_s.ndx + 2];
-    m_T2[0] = new double[(m_s.ndx + 2) * (m_s.ndy + 2)];
-    for (unsigned int i = 1; i < m_s.ndx + 2; i++)
+    // temporal blocking of k iterations needs k layers of ghost cells
+    m_ghosts = m_s.tblock;
+    m_zghosts = (m_s.threeD ? m_ghosts : 0);
+    m_realType = MpiType<Real>::value();
+    m_stride = StencilPaddedStride<Real>(m_s.ndy + 2 * m_ghosts);
+    m_origin = (m_ghosts - 1) * m_stride + m_ghosts - 1;
+    m_planeStride = (m_s.ndx + 2 * m_ghosts) * m_stride;
+    if (m_s.threeD && (m_planeStride * sizeof(Real)) % 4096 == 0)
     {
-        m_T1[i] = m_T1[i - 1] + m_s.ndy + 2;
-        m_T2[i] = m_T2[i - 1] + m_s.ndy + 2;
+        // the same row of the front, middle and back plane would map to the
+        // same cache sets, like rows in StencilPaddedStride()
+        m_planeStride += m_stride;
+    }
+    const int nplanes = (m_s.threeD ? m_s.ndz + 2 * m_zghosts : 1);
+    const size_t n = nplanes * m_planeStride;
+    m_msgRank[Left] = m_s.rank_left;
+    m_msgRank[Right] = m_s.rank_right;
+    m_msgRank[Up] = m_s.rank_up;
+    m_msgRank[Down] = m_s.rank_down;
+    if (m_s.exchange == ExchangeMode::Shared)
+    {
+        initShared(comm, n);
+    }
+    else
+    {
+        m_T1 = StencilAlloc<Real>(n);
+        m_T2 = StencilAlloc<Real>(n);
+    }
+    // first touch: each row is placed in the memory of the NUMA domain of
+    // the thread that updates it in iterate(), which splits the rows of
+    // each plane over the threads
+    const int nrows = m_planeStride / m_stride;
+    for (int k = 0; k < nplanes; ++k)
+    {
+        Real *t1 = m_T1 + k * m_planeStride;
+        Real *t2 = m_T2 + k * m_planeStride;
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < nrows; ++i)
+        {
+            std::fill_n(t1 + i * m_stride, m_stride, 0.0);
+            std::fill_n(t2 + i * m_stride, m_stride, 0.0);
+        }
     }
     m_TCurrent = m_T1;
     m_TNext = m_T2;
+
+    m_isa = StencilDetectISA();
+    m_kernel = StencilRowKernel<Real>(m_isa);
+    m_statsKernel = StencilRowStatsKernel<Real>(m_isa);
+    m_kernel3D = StencilRow3DKernel<Real>(m_isa);
+    m_statsKernel3D = StencilRow3DStatsKernel<Real>(m_isa);
+    m_tile = StencilTileSize(m_s.ndx, m_s.ndy, m_ghosts, m_s.threads,
+                             sizeof(Real));
+
+    if (m_s.threeD)
+    {
+        initFaceTypes();
+    }
+    else if (m_s.exchange == ExchangeMode::NonBlocking ||
+             m_s.exchange == ExchangeMode::Shared)
+    {
+        const size_t ncol = (m_s.ndx + 2 * m_ghosts) * m_ghosts;
+        m_sendLeft.resize(ncol);
+        m_sendRight.resize(ncol);
+        m_recvLeft.resize(ncol);
+        m_recvRight.resize(ncol);
+    }
+    else if (m_s.exchange == ExchangeMode::Persistent)
+    {
+        initTypes();
+        initPersistent(comm);
+    }
+    else if (m_s.exchange == ExchangeMode::Neighbor)
+    {
+        initTypes();
+        initNeighbor();
+    }
+}
+
+template <class Real>
+HeatTransfer<Real>::~HeatTransfer()
+{
+    for (int p = 0; p < 2; ++p)
+    {
+        for (MPI_Request &r : m_columnRequests[p])
+            MPI_Request_free(&r);
+        for (MPI_Request &r : m_rowRequests[p])
+            MPI_Request_free(&r);
+    }
+    if (m_columnType != MPI_DATATYPE_NULL)
+    {
+        MPI_Type_free(&m_columnType);
+        MPI_Type_free(&m_rowType);
+    }
+    if (m_s.threeD)
+    {
+        for (int d = 0; d < 3; ++d)
+            for (int side = 0; side < 2; ++side)
+                for (int dir = 0; dir < 2; ++dir)
+                    MPI_Type_free(&m_faceTypes[d][side][dir]);
+    }
+    if (m_win != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(m_win);
+        MPI_Win_free(&m_win);
+        MPI_Comm_free(&m_nodeComm);
+    }
+    else
+    {
+        StencilFree(m_T1);
+        StencilFree(m_T2);
+    }
+}
+
+/* Allocate T1 and T2 (n elements each) in one shared memory window of all
+ * processes of comm on this node and find T1 and T2 of the neighbors on
+ * the node. All processes have the same array layout.
+ */
+template <class Real>
+void HeatTransfer<Real>::initShared(MPI_Comm comm, size_t n)
+{
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, m_s.rank, MPI_INFO_NULL,
+                        &m_nodeComm);
+
+    // every process gets its own segment (in its own NUMA domain), with
+    // room to align the arrays
+    const size_t line = StencilAlignment / sizeof(Real);
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    Real *base;
+    MPI_Win_allocate_shared((2 * n + line) * sizeof(Real), sizeof(Real),
+                            info, m_nodeComm, &base, &m_win);
+    MPI_Info_free(&info);
+    // passive target epoch for MPI_Win_sync() in startSync()/waitSync()
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, m_win);
+
+    // segments may be mapped at different addresses in each process, so
+    // share the offset of the aligned arrays
+    int pad = (line - (uintptr_t)base / sizeof(Real) % line) % line;
+    int nodeSize;
+    MPI_Comm_size(m_nodeComm, &nodeSize);
+    std::vector<int> pads(nodeSize);
+    MPI_Allgather(&pad, 1, MPI_INT, pads.data(), 1, MPI_INT, m_nodeComm);
+    m_T1 = base + pad;
+    m_T2 = m_T1 + n;
+
+    MPI_Group group, nodeGroup;
+    MPI_Comm_group(comm, &group);
+    MPI_Comm_group(m_nodeComm, &nodeGroup);
+    int nodeRank[4];
+    MPI_Group_translate_ranks(group, 4, m_msgRank, nodeGroup, nodeRank);
+    MPI_Group_free(&group);
+    MPI_Group_free(&nodeGroup);
+    for (int d = 0; d < 4; ++d)
+    {
+        m_peerT1[d] = m_peerT2[d] = nullptr;
+        if (m_msgRank[d] < 0 || nodeRank[d] == MPI_UNDEFINED)
+        {
+            continue;
+        }
+        MPI_Aint size;
+        int unit;
+        MPI_Win_shared_query(m_win, nodeRank[d], &size, &unit, &base);
+        m_peerT1[d] = base + pads[nodeRank[d]];
+        m_peerT2[d] = m_peerT1[d] + n;
+        m_msgRank[d] = -1;
+    }
+}
+
+/* Datatypes of the ghost cells, so there is no packing: the columns are
+ * described by a vector type, the rows are contiguous in memory.
+ * With one ghost layer all transfers are active at the same time and the
+ * corners are not needed, so the columns and rows leave out the ghost cells
+ * to keep the buffers of concurrent transfers apart.
+ */
+template <class Real>
+void HeatTransfer<Real>::initTypes()
+{
+    const int g = m_ghosts;
+    m_firstGhost = (g == 1 ? 1 : 1 - g);
+    const int nrow = (g == 1 ? m_s.ndy : g * m_stride);
+    MPI_Type_vector(m_s.ndx + 2 * (1 - m_firstGhost), g, m_stride, m_realType,
+                    &m_columnType);
+    MPI_Type_commit(&m_columnType);
+    MPI_Type_contiguous(nrow, m_realType, &m_rowType);
+    MPI_Type_commit(&m_rowType);
+}
+
+/* Create the persistent requests of the exchange for both arrays once, so
+ * that an exchange is only MPI_Startall/MPI_Waitall.
+ */
+template <class Real>
+void HeatTransfer<Real>::initPersistent(MPI_Comm comm)
+{
+    const int g = m_ghosts;
+    const int nx = m_s.ndx;
+    const int ny = m_s.ndy;
+    const int i0 = m_firstGhost;
+
+    // same tags as in exchangeBlocking()
+    Real *arrays[2] = {m_T1, m_T2};
+    for (int p = 0; p < 2; ++p)
+    {
+        std::vector<MPI_Request> &cols = m_columnRequests[p];
+        std::vector<MPI_Request> &rows = m_rowRequests[p];
+        Real *top = row(arrays[p], i0);
+        MPI_Request r;
+        if (m_s.rank_left >= 0)
+        {
+            MPI_Recv_init(top + 1 - g, 1, m_columnType, m_s.rank_left, 2, comm,
+                          &r);
+            cols.push_back(r);
+            MPI_Send_init(top + 1, 1, m_columnType, m_s.rank_left, 1, comm,
+                          &r);
+            cols.push_back(r);
+        }
+        if (m_s.rank_right >= 0)
+        {
+            MPI_Recv_init(top + ny + 1, 1, m_columnType, m_s.rank_right, 1,
+                          comm, &r);
+            cols.push_back(r);
+            MPI_Send_init(top + ny - g + 1, 1, m_columnType, m_s.rank_right, 2,
+                          comm, &r);
+            cols.push_back(r);
+        }
+        if (m_s.rank_up >= 0)
+        {
+            MPI_Recv_init(row(arrays[p], 1 - g) + i0, 1, m_rowType,
+                          m_s.rank_up, 3, comm, &r);
+            rows.push_back(r);
+            MPI_Send_init(row(arrays[p], 1) + i0, 1, m_rowType, m_s.rank_up,
+                          4, comm, &r);
+            rows.push_back(r);
+        }
+        if (m_s.rank_down >= 0)
+        {
+            MPI_Recv_init(row(arrays[p], nx + 1) + i0, 1, m_rowType,
+                          m_s.rank_down, 4, comm, &r);
+            rows.push_back(r);
+            MPI_Send_init(row(arrays[p], nx - g + 1) + i0, 1, m_rowType,
+                          m_s.rank_down, 3, comm, &r);
+            rows.push_back(r);
+        }
+    }
 }
 
-HeatTransfer::~HeatTransfer()
+/* Displacements of the ghost cells for MPI_Neighbor_alltoallw. They are
+ * the same for both arrays. Sending and receiving use different base
+ * addresses so the two buffer arguments are not aliased.
+ */
+template <class Real>
+void HeatTransfer<Real>::initNeighbor()
 {
-    delete[] m_T1[0];
-    delete[] m_T1;
-    delete[] m_T2[0];
-    delete[] m_T2;
+    const int g = m_ghosts;
+    const int nx = m_s.ndx;
+    const int ny = m_s.ndy;
+    const int i0 = m_firstGhost;
+    const ptrdiff_t sendBase = m_origin + m_stride + 1;
+    auto offset = [this](ptrdiff_t i, ptrdiff_t j) {
+        return (MPI_Aint)((m_origin + i * m_stride + j) * sizeof(Real));
+    };
+
+    // left, right, up, down
+    const ptrdiff_t send[4][2] = {
+        {i0, 1}, {i0, ny - g + 1}, {1, i0}, {nx - g + 1, i0}};
+    const ptrdiff_t recv[4][2] = {
+        {i0, 1 - g}, {i0, ny + 1}, {1 - g, i0}, {nx + 1, i0}};
+    for (int n = 0; n < 4; ++n)
+    {
+        m_sendDispls[n] = offset(send[n][0], send[n][1]) -
+                          (MPI_Aint)(sendBase * sizeof(Real));
+        m_recvDispls[n] = offset(recv[n][0], recv[n][1]);
+        m_neighborTypes[n] = (n < 2 ? m_columnType : m_rowType);
+    }
 }
 
-void HeatTransfer::init(bool init_with_rank, MPI_Comm comm)
+template <class Real>
+void HeatTransfer<Real>::startNeighbor(MPI_Comm comm, bool columns, bool rows)
 {
+    const int counts[4] = {columns, columns, rows, rows};
+    MPI_Ineighbor_alltoallw(row(m_TCurrent, 1) + 1, counts, m_sendDispls,
+                            m_neighborTypes, m_TCurrent, counts,
+                            m_recvDispls, m_neighborTypes, comm,
+                            &m_neighborRequest);
+}
+
+template <class Real>
+void HeatTransfer<Real>::startAll(std::vector<MPI_Request> &requests)
+{
+    if (!requests.empty())
+    {
+        MPI_Startall(requests.size(), requests.data());
+    }
+}
+
+template <class Real>
+void HeatTransfer<Real>::waitAll(std::vector<MPI_Request> &requests)
+{
+    if (!requests.empty())
+    {
+        MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    }
+}
+
+template <class Real>
+void HeatTransfer<Real>::init(bool init_with_rank, MPI_Comm comm)
+{
+    // the planes with one ghost layer, just k = 1 in 2D
+    const int k0 = (m_s.threeD ? 0 : 1);
+    const int k1 = (m_s.threeD ? m_s.ndz + 1 : 1);
     if (init_with_rank)
     {
-        for (unsigned int i = 0; i < m_s.ndx + 2; i++)
-            for (unsigned int j = 0; j < m_s.ndy + 2; j++)
-                m_T1[i][j] = m_s.rank;
+        for (int k = k0; k <= k1; ++k)
+        {
+            Real *T = plane(m_T1, k);
+#pragma omp parallel for schedule(static)
+            for (unsigned int i = 0; i < m_s.ndx + 2; i++)
+                for (unsigned int j = 0; j < m_s.ndy + 2; j++)
+                    row(T, i)[j] = m_s.rank;
+        }
+    }
+    else if (m_s.init == InitType::Random)
+    {
+        initRandom();
     }
     else
     {
-        const double hx = 2.0 * 4.0 * atan(1.0) / m_s.gndx;
-        const double hy = 2.0 * 4.0 * atan(1.0) / m_s.gndy;
-        double minv = 1.0e30;
-        double maxv = -1.0e30;
-        double x, y, v;
-        for (unsigned int i = 0; i < m_s.ndx + 2; i++)
+        initAnalytic(comm);
+    }
+    m_TCurrent = m_T1;
+    m_TNext = m_T2;
+}
+
+/* The demo values are a sum of waves in x, in y (and in z), so they are
+ * tabulated once per row, column (and plane) of the local array with its
+ * ghost cells. The extremes of the tables give those of T, which is then
+ * normalized to [0..2*edgetemp] while it is written in a single pass.
+ */
+template <class Real>
+void HeatTransfer<Real>::initAnalytic(MPI_Comm comm)
+{
+    const double pi2 = 2.0 * 4.0 * atan(1.0);
+    const double hx = pi2 / m_s.gndx;
+    const double hy = pi2 / m_s.gndy;
+    const double hz = pi2 / m_s.gndz;
+    const int nz = (m_s.threeD ? m_s.ndz + 2 : 1);
+    std::vector<double> fx(m_s.ndx + 2), fy(m_s.ndy + 2), fz(nz, 0.0);
+    for (unsigned int i = 0; i < m_s.ndx + 2; i++)
+    {
+        const double x = hx * ((int)i - 1 + (int)m_s.offsx);
+        fx[i] = cos(8 * x) + cos(6 * x) - cos(4 * x) + cos(2 * x) - cos(x);
+    }
+    for (unsigned int j = 0; j < m_s.ndy + 2; j++)
+    {
+        const double y = hy * ((int)j - 1 + (int)m_s.offsy);
+        fy[j] = sin(8 * y) - sin(6 * y) + sin(4 * y) - sin(2 * y) + sin(y);
+    }
+    if (m_s.threeD)
+    {
+        // in 3D the planes differ by a wave in Z
+        for (int k = 0; k < nz; k++)
         {
-            x = 0.0 + hx * (i - 1 + m_s.posx*m_s.ndx);
+            const double z = hz * (k - 1 + (int)m_s.offsz);
+            fz[k] = cos(4 * z) - cos(2 * z) + sin(z);
+        }
+    }
+    double minv = 0.0, maxv = 0.0;
+    for (const std::vector<double> *f : {&fx, &fy, &fz})
+    {
+        minv += *std::min_element(f->begin(), f->end());
+        maxv += *std::max_element(f->begin(), f->end());
+    }
+
+    double mingv, maxgv;
+    MPI_Allreduce( &minv, &mingv, 1, MPI_DOUBLE, MPI_MIN, comm);
+    MPI_Allreduce( &maxv, &maxgv, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+    // normalize to [0..2*edgetemp]
+    const double skew = 0.0 - mingv;
+    const double ratio = 2*edgetemp / (maxgv-mingv);
+    const int rows = m_s.ndx + 2;
+    const double *y = fy.data();
+    for (int k = 0; k < nz; ++k)
+    {
+        Real *T = plane(m_T1, k + (m_s.threeD ? 0 : 1));
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < rows; i++)
+        {
+            Real *t = row(T, i);
+            const double a = fx[i] + fz[k] + skew;
+#pragma omp simd
             for (unsigned int j = 0; j < m_s.ndy + 2; j++)
             {
-                y = 0.0 + hy * (j - 1 + m_s.posy*m_s.ndy);
-                v = cos(8 * x) + cos(6 * x) - cos(4 * x) + cos(2 * x) -
-                    cos(x) + sin(8 * y) - sin(6 * y) + sin(4 * y) -
-                    sin(2 * y) + sin(y);
-                if (v < minv)
-                {
-                    minv = v;
-                }
-                if (v > maxv)
-                {
-                    maxv = v;
-                }
-                m_T1[i][j] = v;
+                t[j] = Real((a + y[j]) * ratio);
             }
         }
+    }
+}
 
-        double mingv, maxgv;
-        MPI_Allreduce( &minv, &mingv, 1, MPI_DOUBLE, MPI_MIN, comm);
-        MPI_Allreduce( &maxv, &maxgv, 1, MPI_DOUBLE, MPI_MAX, comm);
-
-        // normalize to [0..2*edgetemp]
-        double skew = 0.0 - mingv;
-        double ratio = 2*edgetemp / (maxgv-mingv);
-        for (unsigned int i = 0; i < m_s.ndx + 2; i++)
+/* Uniform random values in [0..2*edgetemp], a hash of the seed and the
+ * global index of each cell, so they do not depend on the decomposition
+ */
+template <class Real>
+void HeatTransfer<Real>::initRandom()
+{
+    const int nz = (m_s.threeD ? m_s.ndz + 2 : 1);
+    const int rows = m_s.ndx + 2;
+    const uint64_t gx = m_s.gndx + 2, gy = m_s.gndy + 2;
+    for (int k = 0; k < nz; ++k)
+    {
+        // global plane, row and column indices count from the first ghost
+        const uint64_t gk = (m_s.threeD ? k + m_s.offsz : 0);
+        Real *T = plane(m_T1, k + (m_s.threeD ? 0 : 1));
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < rows; i++)
         {
+            Real *t = row(T, i);
+            const uint64_t base = (gk * gx + i + m_s.offsx) * gy + m_s.offsy;
             for (unsigned int j = 0; j < m_s.ndy + 2; j++)
             {
-                m_T1[i][j] += skew;
-                m_T1[i][j] *= ratio;
+                // splitmix64 of the seed and the cell
+                uint64_t h = m_s.initSeed + (base + j) * 0x9e3779b97f4a7c15ULL;
+                h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+                h ^= h >> 31;
+                t[j] = Real(2 * edgetemp * std::ldexp(double(h >> 11), -53));
             }
         }
     }
-    m_TCurrent = m_T1;
-    m_TNext = m_T2;
 }
 
-void HeatTransfer::printT(std::string message, MPI_Comm comm) const
+template <class Real>
+void HeatTransfer<Real>::printT(std::string message, MPI_Comm comm) const
 {
     int rank, size;
     int tag = 1;
@@ -118,7 +479,7 @@ void HeatTransfer::printT(std::string message, MPI_Comm comm) const
         std::cout << "  T[" << i << "][] = ";
         for (unsigned int j = 0; j < m_s.ndy + 2; j++)
         {
-            std::cout << std::setw(6) << m_TCurrent[i][j];
+            std::cout << std::setw(6) << T(i, j);
         }
         std::cout << std::endl;
     }
@@ -130,54 +491,472 @@ void HeatTransfer::printT(std::string message, MPI_Comm comm) const
     }
 }
 
-void HeatTransfer::switchCurrentNext()
+template <class Real>
+void HeatTransfer<Real>::switchCurrentNext()
 {
-    double **tmp = m_TCurrent;
+    Real *tmp = m_TCurrent;
     m_TCurrent = m_TNext;
     m_TNext = tmp;
 }
 
-void HeatTransfer::iterate()
+template <class Real>
+void HeatTransfer<Real>::iterate(unsigned int nsteps, bool withStats)
 {
-    for (unsigned int i = 1; i <= m_s.ndx; ++i)
+    StencilStats *stats = nullptr;
+    if (withStats)
     {
-        for (unsigned int j = 1; j <= m_s.ndy; ++j)
+        m_stats = StencilStats();
+        stats = &m_stats;
+    }
+    const double start = MPI_Wtime();
+    if (m_s.threeD)
+        iterate3D(nsteps, stats);
+    else
+        iterate2D(nsteps, stats);
+    m_sweepTime += MPI_Wtime() - start;
+}
+
+template <class Real>
+void HeatTransfer<Real>::iterate2D(unsigned int nsteps, StencilStats *stats)
+{
+    if (nsteps <= 1)
+    {
+        StencilSweep(row(m_TNext, 0), row(m_TCurrent, 0), m_stride, 1,
+                     m_s.ndx + 1, 1, m_s.ndy + 1, m_tile, m_kernel, omega,
+                     m_statsKernel, stats);
+        switchCurrentNext();
+        return;
+    }
+
+    // Temporal blocking: the ghost cells received in the last exchange are
+    // valid for m_ghosts steps. Step s also updates the nsteps-1-s ghost
+    // layers next to a neighbor (redundantly with that neighbor) so that
+    // step s+1 has valid input one layer closer to the local block.
+    // Global edges keep their fixed temperature and are never updated.
+    std::vector<StencilRange> range(nsteps);
+    for (unsigned int s = 0; s < nsteps; ++s)
+    {
+        const ptrdiff_t e = nsteps - 1 - s;
+        range[s].i0 = 1 - (m_s.rank_up >= 0 ? e : 0);
+        range[s].i1 = m_s.ndx + 1 + (m_s.rank_down >= 0 ? e : 0);
+        range[s].j0 = 1 - (m_s.rank_left >= 0 ? e : 0);
+        range[s].j1 = m_s.ndy + 1 + (m_s.rank_right >= 0 ? e : 0);
+    }
+    // the last step updates exactly the local block
+    StencilWavefront(row(m_TCurrent, 0), row(m_TNext, 0), m_stride,
+                     range.data(), nsteps, m_tile, m_kernel, omega,
+                     m_statsKernel, stats);
+    if (nsteps % 2)
+    {
+        switchCurrentNext();
+    }
+}
+
+/* The 3D form of the temporal blocking of iterate(), also for one step:
+ * the levels advance through the planes as a wavefront
+ */
+template <class Real>
+void HeatTransfer<Real>::iterate3D(unsigned int nsteps, StencilStats *stats)
+{
+    nsteps = std::max(nsteps, 1u);
+    std::vector<StencilRange3D> range(nsteps);
+    for (unsigned int s = 0; s < nsteps; ++s)
+    {
+        const ptrdiff_t e = nsteps - 1 - s;
+        range[s].k0 = 1 - (m_s.rank_front >= 0 ? e : 0);
+        range[s].k1 = m_s.ndz + 1 + (m_s.rank_back >= 0 ? e : 0);
+        range[s].i0 = 1 - (m_s.rank_up >= 0 ? e : 0);
+        range[s].i1 = m_s.ndx + 1 + (m_s.rank_down >= 0 ? e : 0);
+        range[s].j0 = 1 - (m_s.rank_left >= 0 ? e : 0);
+        range[s].j1 = m_s.ndy + 1 + (m_s.rank_right >= 0 ? e : 0);
+    }
+    StencilWavefront3D(row(plane(m_TCurrent, 0), 0),
+                       row(plane(m_TNext, 0), 0), m_stride, m_planeStride,
+                       range.data(), nsteps, m_kernel3D, omega,
+                       m_statsKernel3D, stats);
+    if (nsteps % 2)
+    {
+        switchCurrentNext();
+    }
+}
+
+template <class Real>
+void HeatTransfer<Real>::iterateOverlap(MPI_Comm comm, bool withStats)
+{
+    const unsigned int nx = m_s.ndx;
+    const unsigned int ny = m_s.ndy;
+    Real *next = row(m_TNext, 0);
+    const Real *cur = row(m_TCurrent, 0);
+    StencilStats *stats = nullptr;
+    if (withStats)
+    {
+        m_stats = StencilStats();
+        stats = &m_stats;
+    }
+    double start = MPI_Wtime();
+
+    // first and last row, then first and last column of the rows between
+    StencilSweep(next, cur, m_stride, 1, 2, 1, ny + 1, m_tile, m_kernel,
+                 omega, m_statsKernel, stats);
+    if (nx > 1)
+    {
+        StencilSweep(next, cur, m_stride, nx, nx + 1, 1, ny + 1, m_tile,
+                     m_kernel, omega, m_statsKernel, stats);
+    }
+    if (nx > 2)
+    {
+        StencilSweep(next, cur, m_stride, 2, nx, 1, 2, m_tile, m_kernel,
+                     omega, m_statsKernel, stats);
+        if (ny > 1)
         {
-            m_TNext[i][j] =
-                omega / 4 * (m_TCurrent[i - 1][j] + m_TCurrent[i + 1][j] +
-                             m_TCurrent[i][j - 1] + m_TCurrent[i][j + 1]) +
-                (1.0 - omega) * m_TCurrent[i][j];
+            StencilSweep(next, cur, m_stride, 2, nx, ny, ny + 1, m_tile,
+                         m_kernel, omega, m_statsKernel, stats);
         }
     }
+
+    // the new values become current and their edges are sent while the
+    // interior is computed
     switchCurrentNext();
+    m_sweepTime += MPI_Wtime() - start;
+    exchangeStart(comm);
+    start = MPI_Wtime();
+    if (nx > 2 && ny > 2)
+    {
+        StencilSweep(row(m_TCurrent, 0), row(m_TNext, 0), m_stride, 2, nx, 2,
+                     ny, m_tile, m_kernel, omega, m_statsKernel, stats);
+    }
+    m_sweepTime += MPI_Wtime() - start;
+    exchangeFinish(comm);
 }
 
-void HeatTransfer::heatEdges()
+template <class Real>
+void HeatTransfer<Real>::computeStats()
 {
-    // Heat the whole global edges
-    if (m_s.posx == 0)
-        for (unsigned int j = 0; j < m_s.ndy + 2; ++j)
-            m_TCurrent[0][j] = edgetemp;
+    m_stats = StencilStats();
+    // the rows of all planes
+    const int nx = m_s.ndx;
+    const int nrows = m_s.ndz * nx;
+#pragma omp parallel
+    {
+        StencilStats local;
+#pragma omp for schedule(static)
+        for (int r = 0; r < nrows; ++r)
+        {
+            const Real *t = row(plane(m_TCurrent, r / nx + 1), r % nx + 1);
+            for (unsigned int j = 1; j <= m_s.ndy; ++j)
+            {
+                local.min = std::min<double>(local.min, t[j]);
+                local.max = std::max<double>(local.max, t[j]);
+                local.sum += t[j];
+            }
+        }
+#pragma omp critical
+        m_stats.merge(local);
+    }
+    m_stats.cells = (size_t)m_s.ndx * m_s.ndy * m_s.ndz;
+}
+
+template <class Real>
+void HeatTransfer<Real>::heatEdges()
+{
+    // Heat the whole global edges, including the ghost layers beyond the
+    // neighbors' edges. Iterations never write the edges, so doing this in
+    // both arrays keeps them valid for the steps of temporal blocking.
+    const int g = m_ghosts;
+    const int gz = m_zghosts;
+    const int nx = m_s.ndx;
+    const int ny = m_s.ndy;
+    const int nz = m_s.ndz;
+    Real *arrays[2] = {m_TCurrent, m_TNext};
+    for (Real *A : arrays)
+    {
+        // a single plane in 2D; in 3D also the ghost planes, of which the
+        // one at a global edge is heated completely
+        for (int k = 1 - gz; k <= nz + gz; ++k)
+        {
+            Real *T = plane(A, k);
+            const bool edge = (k == 0 && m_s.rank_front < 0) ||
+                              (k == nz + 1 && m_s.rank_back < 0);
+#pragma omp parallel for schedule(static)
+            for (int i = 1 - g; i <= nx + g; ++i)
+            {
+                Real *t = row(T, i);
+                if (edge || (i == 0 && m_s.rank_up < 0) ||
+                    (i == nx + 1 && m_s.rank_down < 0))
+                    std::fill(t + 1 - g, t + ny + g + 1, edgetemp);
+
+                if (m_s.rank_left < 0)
+                    t[0] = edgetemp;
+
+                if (m_s.rank_right < 0)
+                    t[ny + 1] = edgetemp;
+            }
+        }
+    }
+}
+
+template <class Real>
+void HeatTransfer<Real>::exchange(MPI_Comm comm)
+{
+    exchangeStart(comm);
+    exchangeFinish(comm);
+}
+
+template <class Real>
+void HeatTransfer<Real>::exchangeStart(MPI_Comm comm)
+{
+    if (m_s.threeD)
+    {
+        exchange3D(comm);
+        return;
+    }
+    if (m_s.exchange == ExchangeMode::Blocking)
+    {
+        exchangeBlocking(comm);
+        return;
+    }
+    // With more than one ghost layer the rows must carry the columns
+    // received before, so they are exchanged only in exchangeFinish()
+    if (m_s.exchange == ExchangeMode::Neighbor)
+    {
+        startNeighbor(comm, true, m_ghosts == 1);
+        return;
+    }
+    if (m_s.exchange == ExchangeMode::Persistent)
+    {
+        const int p = (m_TCurrent == m_T1 ? 0 : 1);
+        startAll(m_columnRequests[p]);
+        if (m_ghosts == 1)
+        {
+            startAll(m_rowRequests[p]);
+        }
+        return;
+    }
+    if (m_win != MPI_WIN_NULL)
+    {
+        startSync(comm, 5);
+    }
+    startColumns(comm);
+    if (m_ghosts == 1)
+    {
+        startRows(comm);
+    }
+}
 
-    if (m_s.posx == m_s.npx - 1)
-        for (unsigned int j = 0; j < m_s.ndy + 2; ++j)
-            m_TCurrent[m_s.ndx + 1][j] = edgetemp;
+template <class Real>
+void HeatTransfer<Real>::exchangeFinish(MPI_Comm comm)
+{
+    if (m_s.threeD || m_s.exchange == ExchangeMode::Blocking)
+    {
+        return;
+    }
+    if (m_s.exchange == ExchangeMode::Neighbor)
+    {
+        MPI_Wait(&m_neighborRequest, MPI_STATUS_IGNORE);
+        if (m_ghosts > 1)
+        {
+            startNeighbor(comm, false, true);
+            MPI_Wait(&m_neighborRequest, MPI_STATUS_IGNORE);
+        }
+        return;
+    }
+    if (m_s.exchange == ExchangeMode::Persistent)
+    {
+        const int p = (m_TCurrent == m_T1 ? 0 : 1);
+        waitAll(m_columnRequests[p]);
+        if (m_ghosts > 1)
+        {
+            startAll(m_rowRequests[p]);
+        }
+        waitAll(m_rowRequests[p]);
+        return;
+    }
+    if (m_win != MPI_WIN_NULL)
+    {
+        waitSync();
+        copyColumns();
+        if (m_ghosts == 1)
+        {
+            copyRows();
+        }
+    }
+    MPI_Waitall(m_nrequests, m_requests, MPI_STATUSES_IGNORE);
+    m_nrequests = 0;
+    if (m_msgRank[Left] >= 0)
+        unpackColumns(m_recvLeft.data(), 1 - m_ghosts);
+    if (m_msgRank[Right] >= 0)
+        unpackColumns(m_recvRight.data(), m_s.ndy + 1);
+
+    if (m_ghosts > 1)
+    {
+        if (m_win != MPI_WIN_NULL)
+        {
+            // our ghost columns are complete, the corners of the rows
+            startSync(comm, 6);
+        }
+        startRows(comm);
+        if (m_win != MPI_WIN_NULL)
+        {
+            waitSync();
+            copyRows();
+            // the temporal blocking of iterate() also writes the current
+            // array, so wait until the neighbors have copied from it
+            startSync(comm, 7);
+            waitSync();
+        }
+        MPI_Waitall(m_nrequests, m_requests, MPI_STATUSES_IGNORE);
+        m_nrequests = 0;
+    }
+}
+
+/* A zero-byte message to each on-node neighbor says that our cells are
+ * ready to be copied. A neighbor copies them before it sends the message
+ * of the next exchange, and we do not write that array again before
+ * receiving it, so no other synchronization is needed.
+ */
+template <class Real>
+void HeatTransfer<Real>::startSync(MPI_Comm comm, int tag)
+{
+    MPI_Win_sync(m_win);
+    const int ranks[4] = {m_s.rank_left, m_s.rank_right, m_s.rank_up,
+                          m_s.rank_down};
+    for (int d = 0; d < 4; ++d)
+    {
+        if (m_peerT1[d])
+        {
+            MPI_Irecv(nullptr, 0, MPI_BYTE, ranks[d], tag, comm,
+                      &m_syncRequests[m_nsync++]);
+            MPI_Isend(nullptr, 0, MPI_BYTE, ranks[d], tag, comm,
+                      &m_syncRequests[m_nsync++]);
+        }
+    }
+}
+
+template <class Real>
+void HeatTransfer<Real>::waitSync()
+{
+    MPI_Waitall(m_nsync, m_syncRequests, MPI_STATUSES_IGNORE);
+    m_nsync = 0;
+    MPI_Win_sync(m_win);
+}
+
+/* Copy the ghost columns from the neighbors on this node, only for the
+ * rows of the local array, the ghost rows are copied by copyRows()
+ */
+template <class Real>
+void HeatTransfer<Real>::copyColumns()
+{
+    const int g = m_ghosts;
+    const int ny = m_s.ndy;
+    Real *const *peers = (m_TCurrent == m_T1 ? m_peerT1 : m_peerT2);
+#pragma omp parallel for schedule(static)
+    for (int i = 1; i <= (int)m_s.ndx; ++i)
+    {
+        Real *t = row(m_TCurrent, i);
+        if (peers[Left])
+            std::copy_n(row(peers[Left], i) + ny - g + 1, g, t + 1 - g);
+        if (peers[Right])
+            std::copy_n(row(peers[Right], i) + 1, g, t + ny + 1);
+    }
+}
+
+/* Copy the ghost rows from the neighbors on this node. With more than one
+ * ghost layer they include the corners from the neighbors' ghost columns.
+ */
+template <class Real>
+void HeatTransfer<Real>::copyRows()
+{
+    const int g = m_ghosts;
+    const int nx = m_s.ndx;
+    const int j0 = (g == 1 ? 1 : 1 - g);
+    const int len = (g == 1 ? m_s.ndy : m_s.ndy + 2 * g);
+    Real *const *peers = (m_TCurrent == m_T1 ? m_peerT1 : m_peerT2);
+    for (int r = 0; r < g; ++r)
+    {
+        if (peers[Up])
+            std::copy_n(row(peers[Up], nx - g + 1 + r) + j0, len,
+                        row(m_TCurrent, 1 - g + r) + j0);
+        if (peers[Down])
+            std::copy_n(row(peers[Down], 1 + r) + j0, len,
+                        row(m_TCurrent, nx + 1 + r) + j0);
+    }
+}
 
-    if (m_s.posy == 0)
-        for (unsigned int i = 0; i < m_s.ndx + 2; ++i)
-            m_TCurrent[i][0] = edgetemp;
+template <class Real>
+void HeatTransfer<Real>::startColumns(MPI_Comm comm)
+{
+    // same tags as in exchangeBlocking(): 1 to the left, 2 to the right
+    const int g = m_ghosts;
+    const int ncol = m_sendLeft.size();
+    if (m_msgRank[Left] >= 0)
+    {
+        MPI_Irecv(m_recvLeft.data(), ncol, m_realType, m_msgRank[Left], 2, comm,
+                  &m_requests[m_nrequests++]);
+    }
+    if (m_msgRank[Right] >= 0)
+    {
+        MPI_Irecv(m_recvRight.data(), ncol, m_realType, m_msgRank[Right], 1,
+                  comm, &m_requests[m_nrequests++]);
+    }
+    if (m_msgRank[Left] >= 0)
+    {
+        packColumns(m_sendLeft.data(), 1);
+        MPI_Isend(m_sendLeft.data(), ncol, m_realType, m_msgRank[Left], 1, comm,
+                  &m_requests[m_nrequests++]);
+    }
+    if (m_msgRank[Right] >= 0)
+    {
+        packColumns(m_sendRight.data(), m_s.ndy - g + 1);
+        MPI_Isend(m_sendRight.data(), ncol, m_realType, m_msgRank[Right], 2,
+                  comm, &m_requests[m_nrequests++]);
+    }
+}
 
-    if (m_s.posy == m_s.npy - 1)
-        for (unsigned int i = 0; i < m_s.ndx + 2; ++i)
-            m_TCurrent[i][m_s.ndy + 1] = edgetemp;
+template <class Real>
+void HeatTransfer<Real>::startRows(MPI_Comm comm)
+{
+    // same tags as in exchangeBlocking(): 3 down, 4 up
+    const int g = m_ghosts;
+    const int nx = m_s.ndx;
+    const int nrow = g * m_stride;
+    if (m_msgRank[Up] >= 0)
+    {
+        MPI_Irecv(row(m_TCurrent, 1 - g) + 1 - g, nrow, m_realType,
+                  m_msgRank[Up], 3, comm, &m_requests[m_nrequests++]);
+    }
+    if (m_msgRank[Down] >= 0)
+    {
+        MPI_Irecv(row(m_TCurrent, nx + 1) + 1 - g, nrow, m_realType,
+                  m_msgRank[Down], 4, comm, &m_requests[m_nrequests++]);
+    }
+    if (m_msgRank[Up] >= 0)
+    {
+        MPI_Isend(row(m_TCurrent, 1) + 1 - g, nrow, m_realType,
+                  m_msgRank[Up], 4, comm, &m_requests[m_nrequests++]);
+    }
+    if (m_msgRank[Down] >= 0)
+    {
+        MPI_Isend(row(m_TCurrent, nx - g + 1) + 1 - g, nrow, m_realType,
+                  m_msgRank[Down], 3, comm, &m_requests[m_nrequests++]);
+    }
 }
 
-void HeatTransfer::exchange(MPI_Comm comm)
+template <class Real>
+void HeatTransfer<Real>::exchangeBlocking(MPI_Comm comm)
 {
     // Exchange ghost cells, in the order left-right-up-down
+    // With temporal blocking, m_ghosts layers are exchanged in each
+    // direction. Columns include the ghost rows and rows include the ghost
+    // columns just received, so the corner cells get the diagonal
+    // neighbors' values too.
+    const int g = m_ghosts;
+    const int nx = m_s.ndx;
+    const int ny = m_s.ndy;
+    const int ncol = (nx + 2 * g) * g; // elements in g columns
+    const int nrow = g * m_stride;     // elements in g rows, with padding
 
-    double *send_x = new double[m_s.ndx + 2];
-    double *recv_x = new double[m_s.ndx + 2];
+    Real *send_x = new Real[ncol];
+    Real *recv_x = new Real[ncol];
 
     // send to left + receive from right
     int tag = 1;
@@ -186,18 +965,15 @@ void HeatTransfer::exchange(MPI_Comm comm)
     {
         // std::cout << "Rank " << m_s.rank << " send left to rank "
         //          << m_s.rank_left << std::endl;
-        for (unsigned int i = 0; i < m_s.ndx + 2; ++i)
-            send_x[i] = m_TCurrent[i][1];
-        MPI_Send(send_x, m_s.ndx + 2, MPI_REAL8, m_s.rank_left, tag, comm);
+        packColumns(send_x, 1);
+        MPI_Send(send_x, ncol, m_realType, m_s.rank_left, tag, comm);
     }
     if (m_s.rank_right >= 0)
     {
         // std::cout << "Rank " << m_s.rank << " receive from right from rank "
         //          << m_s.rank_right << std::endl;
-        MPI_Recv(recv_x, m_s.ndx + 2, MPI_REAL8, m_s.rank_right, tag, comm,
-                 &status);
-        for (unsigned int i = 0; i < m_s.ndx + 2; ++i)
-            m_TCurrent[i][m_s.ndy + 1] = recv_x[i];
+        MPI_Recv(recv_x, ncol, m_realType, m_s.rank_right, tag, comm, &status);
+        unpackColumns(recv_x, ny + 1);
     }
 
     // send to right + receive from left
@@ -206,18 +982,15 @@ void HeatTransfer::exchange(MPI_Comm comm)
     {
         // std::cout << "Rank " << m_s.rank << " send right to rank "
         //          << m_s.rank_right << std::endl;
-        for (unsigned int i = 0; i < m_s.ndx + 2; ++i)
-            send_x[i] = m_TCurrent[i][m_s.ndy];
-        MPI_Send(send_x, m_s.ndx + 2, MPI_REAL8, m_s.rank_right, tag, comm);
+        packColumns(send_x, ny - g + 1);
+        MPI_Send(send_x, ncol, m_realType, m_s.rank_right, tag, comm);
     }
     if (m_s.rank_left >= 0)
     {
         // std::cout << "Rank " << m_s.rank << " receive from left from rank "
         //          << m_s.rank_left << std::endl;
-        MPI_Recv(recv_x, m_s.ndx + 2, MPI_REAL8, m_s.rank_left, tag, comm,
-                 &status);
-        for (unsigned int i = 0; i < m_s.ndx + 2; ++i)
-            m_TCurrent[i][0] = recv_x[i];
+        MPI_Recv(recv_x, ncol, m_realType, m_s.rank_left, tag, comm, &status);
+        unpackColumns(recv_x, 1 - g);
     }
 
     // send down + receive from above
@@ -226,15 +999,15 @@ void HeatTransfer::exchange(MPI_Comm comm)
     {
         // std::cout << "Rank " << m_s.rank << " send down to rank "
         //          << m_s.rank_down << std::endl;
-        MPI_Send(m_TCurrent[m_s.ndx], m_s.ndy + 2, MPI_REAL8, m_s.rank_down,
-                 tag, comm);
+        MPI_Send(row(m_TCurrent, nx - g + 1) + 1 - g, nrow, m_realType,
+                 m_s.rank_down, tag, comm);
     }
     if (m_s.rank_up >= 0)
     {
         // std::cout << "Rank " << m_s.rank << " receive from above from rank "
         //          << m_s.rank_up << std::endl;
-        MPI_Recv(m_TCurrent[0], m_s.ndy + 2, MPI_REAL8, m_s.rank_up, tag, comm,
-                 &status);
+        MPI_Recv(row(m_TCurrent, 1 - g) + 1 - g, nrow, m_realType, m_s.rank_up,
+                 tag, comm, &status);
     }
 
     // send up + receive from below
@@ -244,32 +1017,180 @@ void HeatTransfer::exchange(MPI_Comm comm)
         // std::cout << "Rank " << m_s.rank << " send up to rank " <<
         // m_s.rank_up
         //          << std::endl;
-        MPI_Send(m_TCurrent[1], m_s.ndy + 2, MPI_REAL8, m_s.rank_up, tag, comm);
+        MPI_Send(row(m_TCurrent, 1) + 1 - g, nrow, m_realType, m_s.rank_up, tag,
+                 comm);
     }
     if (m_s.rank_down >= 0)
     {
         // std::cout << "Rank " << m_s.rank << " receive from below from rank "
         //          << m_s.rank_down << std::endl;
-        MPI_Recv(m_TCurrent[m_s.ndx + 1], m_s.ndy + 2, MPI_REAL8, m_s.rank_down,
-                 tag, comm, &status);
+        MPI_Recv(row(m_TCurrent, nx + 1) + 1 - g, nrow, m_realType,
+                 m_s.rank_down, tag, comm, &status);
     }
 
     delete[] send_x;
     delete[] recv_x;
 }
 
-#include <cstring>
-/* Copies the internal ndx*ndy section of the ndx+2 * ndy+2 local array
- * into a separate contiguous vector and returns it.
- * @return A vector with ndx*ndy elements
+/* Copy m_ghosts columns starting at column j0, over all rows including the
+ * ghost rows, into buf (row by row)
  */
-std::vector<double> HeatTransfer::data_noghost() const
+template <class Real>
+void HeatTransfer<Real>::packColumns(Real *buf, int j0) const
 {
-    std::vector<double> d(m_s.ndx * m_s.ndy);
-    for (unsigned int i = 1; i <= m_s.ndx; ++i)
+    const int g = m_ghosts;
+#pragma omp parallel for schedule(static)
+    for (int i = 1 - g; i <= (int)m_s.ndx + g; ++i)
     {
-        std::memcpy(&d[(i - 1) * m_s.ndy], m_TCurrent[i] + 1,
-                    m_s.ndy * sizeof(double));
+        const Real *t = row(m_TCurrent, i) + j0;
+        std::copy_n(t, g, buf + (i - 1 + g) * g);
     }
+}
+
+/* The reverse of packColumns() */
+template <class Real>
+void HeatTransfer<Real>::unpackColumns(const Real *buf, int j0)
+{
+    const int g = m_ghosts;
+#pragma omp parallel for schedule(static)
+    for (int i = 1 - g; i <= (int)m_s.ndx + g; ++i)
+    {
+        Real *t = row(m_TCurrent, i) + j0;
+        std::copy_n(buf + (i - 1 + g) * g, g, t);
+    }
+}
+
+/* The subarrays of the ghost cells of all three dimensions in the whole
+ * allocation of an array, which holds planes of rows of m_stride elements.
+ * A face covers the full extent of the other two dimensions, ghost cells
+ * included, so the columns, rows and planes exchanged in that order carry
+ * the edges and corners along.
+ */
+template <class Real>
+void HeatTransfer<Real>::initFaceTypes()
+{
+    const int g = m_ghosts;
+    const int n[3] = {(int)m_s.ndy, (int)m_s.ndx, (int)m_s.ndz};
+    // allocated sizes of the planes, rows and columns
+    const int sizes[3] = {(int)m_s.ndz + 2 * g, (int)(m_planeStride / m_stride),
+                          (int)m_stride};
+    for (int d = 0; d < 3; ++d)
+    {
+        // index of the dimension in sizes[]: Y columns, X rows, Z planes
+        const int a = 2 - d;
+        int sub[3] = {sizes[0], (int)m_s.ndx + 2 * g, (int)m_s.ndy + 2 * g};
+        sub[a] = g;
+        // first own cells and first ghost cells on the lower and upper side
+        const int first[2][2] = {{g, 0}, {n[d], n[d] + g}};
+        for (int side = 0; side < 2; ++side)
+        {
+            for (int dir = 0; dir < 2; ++dir)
+            {
+                int start[3] = {0, 0, 0};
+                start[a] = first[side][dir];
+                MPI_Type_create_subarray(3, sizes, sub, start, MPI_ORDER_C,
+                                         m_realType,
+                                         &m_faceTypes[d][side][dir]);
+                MPI_Type_commit(&m_faceTypes[d][side][dir]);
+            }
+        }
+    }
+}
+
+/* Exchange the ghost columns, then the ghost rows, then the ghost planes.
+ * The blocking mode sends to the lower neighbor and receives from the upper
+ * one with MPI_Sendrecv and then the other way around; the non-blocking
+ * mode posts both directions of a dimension at once.
+ */
+template <class Real>
+void HeatTransfer<Real>::exchange3D(MPI_Comm comm)
+{
+    const int neighbors[3][2] = {{m_s.rank_left, m_s.rank_right},
+                                 {m_s.rank_up, m_s.rank_down},
+                                 {m_s.rank_front, m_s.rank_back}};
+    // tags of the messages to the lower and to the upper neighbor, the
+    // same as in exchangeBlocking() for the columns and rows
+    const int tags[3][2] = {{1, 2}, {4, 3}, {8, 9}};
+    for (int d = 0; d < 3; ++d)
+    {
+        int peer[2];
+        for (int side = 0; side < 2; ++side)
+            peer[side] = (neighbors[d][side] >= 0 ? neighbors[d][side]
+                                                  : MPI_PROC_NULL);
+        if (peer[0] == MPI_PROC_NULL && peer[1] == MPI_PROC_NULL)
+        {
+            continue;
+        }
+        MPI_Datatype(&types)[2][2] = m_faceTypes[d];
+        if (m_s.exchange == ExchangeMode::Blocking)
+        {
+            for (int side = 0; side < 2; ++side)
+            {
+                MPI_Sendrecv(m_TCurrent, 1, types[side][0], peer[side],
+                             tags[d][side], m_TCurrent, 1, types[1 - side][1],
+                             peer[1 - side], tags[d][side], comm,
+                             MPI_STATUS_IGNORE);
+            }
+        }
+        else
+        {
+            MPI_Request requests[4];
+            for (int side = 0; side < 2; ++side)
+            {
+                MPI_Irecv(m_TCurrent, 1, types[side][1], peer[side],
+                          tags[d][1 - side], comm, &requests[side]);
+            }
+            for (int side = 0; side < 2; ++side)
+            {
+                MPI_Isend(m_TCurrent, 1, types[side][0], peer[side],
+                          tags[d][side], comm, &requests[2 + side]);
+            }
+            MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+        }
+    }
+}
+
+#include <cstring>
+/* Copies the internal ndx*ndy section of the (ndx+2) * stride local array
+ * (of every plane in 3D) into a separate contiguous vector and returns it.
+ * @return A vector with ndz*ndx*ndy elements
+ */
+template <class Real>
+std::vector<Real> HeatTransfer<Real>::data_noghost() const
+{
+    std::vector<Real> d(m_s.ndz * m_s.ndx * m_s.ndy);
+    data_noghost(d.data());
     return d;
 }
+
+/* Copies the internal ndz*ndx*ndy section into d */
+template <class Real>
+void HeatTransfer<Real>::data_noghost(Real *d) const
+{
+    const int nrows = m_s.ndz * m_s.ndx;
+#pragma omp parallel for schedule(static)
+    for (int r = 0; r < nrows; ++r)
+    {
+        std::memcpy(&d[r * m_s.ndy],
+                    row(plane(m_TCurrent, r / m_s.ndx + 1), r % m_s.ndx + 1) +
+                        1,
+                    m_s.ndy * sizeof(Real));
+    }
+}
+
+/* Copies d into the internal ndz*ndx*ndy section */
+template <class Real>
+void HeatTransfer<Real>::set_noghost(const Real *d)
+{
+    const int nrows = m_s.ndz * m_s.ndx;
+#pragma omp parallel for schedule(static)
+    for (int r = 0; r < nrows; ++r)
+    {
+        std::memcpy(row(plane(m_TCurrent, r / m_s.ndx + 1), r % m_s.ndx + 1) +
+                        1,
+                    &d[r * m_s.ndy], m_s.ndy * sizeof(Real));
+    }
+}
+
+template class HeatTransfer<double>;
+template class HeatTransfer<float>;
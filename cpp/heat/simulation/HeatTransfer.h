@@ -16,40 +16,208 @@
 #include <vector>
 
 #include "Settings.h"
+#include "Stencil.h"
 
+/* The MPI datatype of a Real */
+template <class Real>
+struct MpiType;
+template <>
+struct MpiType<double>
+{
+    static MPI_Datatype value() { return MPI_DOUBLE; }
+};
+template <>
+struct MpiType<float>
+{
+    static MPI_Datatype value() { return MPI_FLOAT; }
+};
+
+/* The local array of T and its ghost cells in Real (double or float)
+ * storage, which is also the precision the stencil computes in. The
+ * statistics are accumulated in double. HeatTransfer.cpp instantiates it
+ * for double and float. With Settings::threeD the array is a volume of
+ * ndz planes of ndx x ndy cells with ghost planes around it; a 2D array is
+ * a single plane without them.
+ */
+template <class Real>
 class HeatTransfer
 {
 public:
-    HeatTransfer(const Settings &settings); // Create two 2D arrays with ghost
-                                            // cells to compute
+    // Create two 2D (or 3D) arrays with ghost cells to compute, exchanging
+    // ghost cells in the communicator comm
+    HeatTransfer(const Settings &settings, MPI_Comm comm);
     ~HeatTransfer();
     void init(bool init_with_rank, MPI_Comm comm); // set up array values with either rank or
-                                    // real demo values
-    void iterate();                 // one local calculation step
+                                    // the initial condition of Settings::init
+                                    // (analytic or random; a file is read
+                                    // by IO::readInitial())
+    // nsteps local calculation steps, at most ghosts() at once; with
+    // withStats the statistics of the last one are kept for stats()
+    void iterate(unsigned int nsteps = 1, bool withStats = false);
     void heatEdges();               // reset the heat values at the global edge
     void exchange(MPI_Comm comm);   // send updates to neighbors
+    void exchangeStart(MPI_Comm comm);  // start sending updates to neighbors
+    void exchangeFinish(MPI_Comm comm); // wait for the updates of neighbors
+    // one local calculation step and the exchange of its results: the
+    // cells next to the ghost cells are computed first, then the interior
+    // while they are sent to the neighbors
+    void iterateOverlap(MPI_Comm comm, bool withStats = false);
+    // statistics of the local array from the last iterate() with
+    // withStats, or from computeStats()
+    const StencilStats &stats() const { return m_stats; };
+    // statistics of the local array in a separate pass, without a change
+    void computeStats();
 
-    // return a single value at index i,j. 0 <= i <= ndx+2, 0 <= j <= ndy+2
-    double T(int i, int j) const { return m_TCurrent[i][j]; };
-    // return (1D) pointer to current T data, ndx+2 * ndy+2 elements
-    double *data() const { return m_TCurrent[0]; };
-    // return (1D) pointer to current T data without ghost cells, ndx*ndy
-    // elements
-    std::vector<double> data_noghost() const;
+    // return a single value at index i,j. 0 <= i <= ndx+1, 0 <= j <= ndy+1
+    Real T(int i, int j) const
+    {
+        return m_TCurrent[m_origin + i * m_stride + j];
+    };
+    // return a single value at index k,i,j of plane 0 <= k <= ndz+1 in 3D,
+    // k = 1 in 2D
+    Real T(int k, int i, int j) const
+    {
+        return plane(m_TCurrent, k)[m_origin + i * m_stride + j];
+    };
+    // return (1D) pointer to current T data, ndx+2*ghosts() rows of stride()
+    // elements, cell (1-ghosts(),1-ghosts()) first; in 3D ndz+2*ghosts()
+    // such planes, planeStride() elements apart
+    Real *data() const { return m_TCurrent; };
+    // number of elements between the start of two rows, >= ndy+2*ghosts()
+    size_t stride() const { return m_stride; };
+    // number of elements between the start of two planes, >= rows*stride()
+    size_t planeStride() const { return m_planeStride; };
+    // number of ghost cell layers around the local array
+    unsigned int ghosts() const { return m_ghosts; };
+    // seconds spent in the stencil sweeps of iterate() and iterateOverlap(),
+    // without the exchanges, as a measure of the speed of this process
+    double sweepTime() const { return m_sweepTime; };
+    // name of the instruction set the stencil kernel uses
+    const char *kernelName() const { return StencilISAName(m_isa); };
+    // return (1D) pointer to current T data without ghost cells,
+    // ndz*ndx*ndy elements (ndz is 1 in 2D)
+    std::vector<Real> data_noghost() const;
+    // copy the ndz*ndx*ndy elements without ghost cells into d
+    void data_noghost(Real *d) const;
+    // set the ndz*ndx*ndy elements without ghost cells from d (ghost cells
+    // need heatEdges() and exchange() afterwards)
+    void set_noghost(const Real *d);
 
     void printT(std::string message,
                 MPI_Comm comm) const; // debug: print local TCurrent on stdout
 
 private:
-    const double edgetemp = 100.0; // temperature at the edges of the global plate
-    const double omega =
+    const Real edgetemp = 100.0; // temperature at the edges of the global plate
+    const Real omega =
         0.8;       // weight for current temp is (1-omega) in iteration
-    double **m_T1; // 2D array (ndx+2) * (ndy+2) size, including ghost cells
-    double **m_T2; // another 2D array
-    double **m_TCurrent; // pointer to T1 or T2
-    double **m_TNext;    // pointer to T2 or T1
+    Real *m_T1;   // 2D array (ndx+2g) * (ndy+2g) size, including g layers
+                  // of ghost cells, rows are m_stride elements apart and
+                  // 64-byte aligned
+    Real *m_T2;   // another 2D array
+    Real *m_TCurrent; // pointer to T1 or T2
+    Real *m_TNext;    // pointer to T2 or T1
+    size_t m_stride;    // padded row length of T1 and T2
+    size_t m_planeStride; // padded plane size of T1 and T2
+    size_t m_origin;    // offset of cell (0,0) in a plane of T1 and T2
+    unsigned int m_ghosts; // number of ghost cell layers
+    unsigned int m_zghosts; // number of ghost planes, 0 in 2D
+    StencilISA m_isa;   // instruction set of the stencil kernel
+    StencilRowFunc<Real> m_kernel;
+    StencilRowStatsFunc<Real> m_statsKernel;
+    StencilRow3DFunc<Real> m_kernel3D;
+    StencilRow3DStatsFunc<Real> m_statsKernel3D;
+    StencilStats m_stats;
+    StencilTile m_tile; // cache tile of a sweep in iterate()
+    double m_sweepTime = 0.0;
     const Settings &m_s;
+    // pointer to cell (i,0) of array T, 1-ghosts <= i <= ndx+ghosts
+    Real *row(Real *T, int i) const
+    {
+        return T + m_origin + (ptrdiff_t)i * m_stride;
+    };
+    // array T shifted to plane k, 1-ghosts <= k <= ndz+ghosts in 3D, so
+    // that row() of it addresses that plane; T itself for k = 1 in 2D
+    Real *plane(Real *T, int k) const
+    {
+        return T + (ptrdiff_t)(k - 1 + (int)m_zghosts) * m_planeStride;
+    };
+    // neighbors in the order of the cartesian communicator
+    enum Side
+    {
+        Left,
+        Right,
+        Up,
+        Down
+    };
+    // neighbors reached by the non-blocking exchange, -1 if there is no
+    // such neighbor or it is on this node in the shared mode
+    int m_msgRank[4];
+    MPI_Datatype m_realType; // MPI_DOUBLE or MPI_FLOAT for Real
+    void packColumns(Real *buf, int j0) const;
+    void unpackColumns(const Real *buf, int j0);
+    void exchangeBlocking(MPI_Comm comm);
+    void startColumns(MPI_Comm comm); // non-blocking exchange of columns
+    void startRows(MPI_Comm comm);    // non-blocking exchange of rows
+
+    // buffers and requests of the non-blocking exchange
+    std::vector<Real> m_sendLeft, m_sendRight, m_recvLeft, m_recvRight;
+    MPI_Request m_requests[8];
+    int m_nrequests = 0;
+
+    // datatypes of m_ghosts columns and rows to send or receive
+    MPI_Datatype m_columnType = MPI_DATATYPE_NULL;
+    MPI_Datatype m_rowType = MPI_DATATYPE_NULL;
+    int m_firstGhost; // first row/column of m_columnType/m_rowType
+    void initTypes();
+
+    // persistent requests of the exchange of T1 (0) and T2 (1), for the
+    // columns and for the rows of the ghost cells
+    std::vector<MPI_Request> m_columnRequests[2];
+    std::vector<MPI_Request> m_rowRequests[2];
+    void initPersistent(MPI_Comm comm);
+
+    // neighborhood collective: displacements in bytes from cell (1,1) for
+    // sending and from the start of the array for receiving, in the order
+    // of the cartesian neighbors (left, right, up, down)
+    MPI_Aint m_sendDispls[4];
+    MPI_Aint m_recvDispls[4];
+    MPI_Datatype m_neighborTypes[4];
+    MPI_Request m_neighborRequest = MPI_REQUEST_NULL;
+    void initNeighbor();
+    void startNeighbor(MPI_Comm comm, bool columns, bool rows);
+
+    // shared mode: T1 and T2 are allocated in a shared memory window of the
+    // node, and the ghost cells of neighbors on the node are copied from
+    // their T1 and T2 (nullptr for neighbors reached by messages)
+    MPI_Comm m_nodeComm = MPI_COMM_NULL;
+    MPI_Win m_win = MPI_WIN_NULL;
+    Real *m_peerT1[4];
+    Real *m_peerT2[4];
+    MPI_Request m_syncRequests[8];
+    int m_nsync = 0;
+    void initShared(MPI_Comm comm, size_t n);
+    void startSync(MPI_Comm comm, int tag); // tell on-node neighbors that
+                                            // our cells are ready
+    void waitSync(); // wait until the on-node neighbors' cells are ready
+    void copyColumns(); // copy ghost columns from on-node neighbors
+    void copyRows();    // copy ghost rows from on-node neighbors
+    void startAll(std::vector<MPI_Request> &requests);
+    void waitAll(std::vector<MPI_Request> &requests);
     void switchCurrentNext(); // switch the current array with the next array
+    // initial conditions of init()
+    void initAnalytic(MPI_Comm comm);
+    void initRandom();
+    // the sweeps of iterate() on the 2D array, with temporal blocking
+    void iterate2D(unsigned int nsteps, StencilStats *stats);
+
+    // 3D: subarray datatypes of the ghost columns, rows and planes to send
+    // (0) to and receive (1) from the lower and the upper neighbor of each
+    // dimension, exchanged one dimension after the other so that the edges
+    // and corners of the ghost layers arrive too
+    MPI_Datatype m_faceTypes[3][2][2];
+    void initFaceTypes();
+    void exchange3D(MPI_Comm comm);
+    void iterate3D(unsigned int nsteps, StencilStats *stats);
 };
 
 #endif /* HEATTRANSFER_H_ */
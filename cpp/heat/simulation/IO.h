@@ -13,16 +13,128 @@
 
 #include "HeatTransfer.h"
 #include "Settings.h"
+#include "StagingPool.h"
 
 #include <mpi.h>
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Output of a HeatTransfer<Real>: T, its reduced forms and the checkpoints
+ * are written in Real. IO_adios2.cpp instantiates it for double and float.
+ */
+template <class Real>
 class IO
 {
 public:
     IO(const Settings &s, MPI_Comm comm);
     ~IO();
-    void write(int step, const HeatTransfer &ht, const Settings &s,
-               MPI_Comm comm);
+    // Output one step. With Settings::async the local array is copied into
+    // a staging buffer and written by a background thread; this waits only
+    // if Settings::asyncSteps steps are already in flight.
+    void write(int step, const HeatTransfer<Real> &ht, const Settings &s);
+    // Write a checkpoint of the local array, the step and the solver's
+    // iteration counter in the background; the ghost cells are not stored,
+    // restart() rebuilds them
+    void checkpoint(unsigned int step, unsigned long iteration,
+                    const HeatTransfer<Real> &ht);
+    // Read the last checkpoint into ht, for this process' part of the global
+    // array, so the number of processes may differ from the checkpointed
+    // run. It replaces ht.init(); call heatEdges() and exchange() afterwards.
+    // The output steps the interrupted run wrote after the checkpoint are
+    // not written again by write().
+    // @param iteration the iteration counter of the checkpoint
+    // @return the output step of the checkpoint
+    unsigned int restart(HeatTransfer<Real> &ht, unsigned long &iteration,
+                         MPI_Comm comm);
+    // Read the initial T of --init file, this process' part of T at the
+    // given step of an ADIOS2 file in either precision, into ht. Call
+    // heatEdges() and exchange() afterwards.
+    void readInitial(HeatTransfer<Real> &ht, MPI_Comm comm);
+    // wait until all steps in flight are written
+    void flush();
+    // Write the block of this process in the changed Settings (after
+    // rebalancing) from the next step on; call flush() before the blocks
+    // change
+    void resize();
+    // flush and close the output and checkpoint files
+    void close();
+    // seconds the background thread spent writing, and the part of it the
+    // solver had to wait for in write() and flush()
+    double backgroundTime() const { return m_backgroundTime; };
+    double waitTime() const { return m_waitTime; };
+    // the staging buffers of the asynchronous output, nullptr if sync
+    const StagingPool *stagingPool() const { return m_pool.get(); };
+    // seconds spent in the output steps (in the background with async),
+    // including the compression of T, and the bytes of T they wrote before
+    // compression
+    double writeTime() const { return m_writeTime; };
+    size_t rawBytes() const { return m_rawBytes; };
+    // output steps with the full T
+    unsigned int fullSteps() const { return m_fullSteps; };
+    // name of the operator compressing T, empty if it is not compressed
+    const std::string &compression() const { return m_compression; };
+    // bytes of the output file(s) on disk after close(), 0 if the engine
+    // does not write to the file system
+    size_t outputBytes() const;
+
+private:
+    const Settings &m_s;
+    bool m_async;
+    MPI_Comm m_comm = MPI_COMM_NULL; // duplicate for the background thread
+    bool m_closed = false;
+    std::string m_compression;
+    std::vector<Real> m_buffer; // contiguous T for the operator when sync
+    std::vector<Real> m_decimated; // local part of the decimated T
+    std::vector<Real> m_roi;       // local part of the region of interest
+    size_t m_roiBox[4] = {0, 0, 0, 0}; // its local offset and size
+    double m_blockStats[4]; // min, max, mean, change of the local array
+    double m_writeTime = 0.0;
+    size_t m_rawBytes = 0;
+    unsigned int m_fullSteps = 0;
+    unsigned int m_outputSteps = 0; // steps in the output file, or skipped
+    unsigned int m_fileSteps = 0;   // in the output file when restarted
+    unsigned int m_skipSteps = 0;   // of the interrupted run, not written
+
+    std::unique_ptr<StagingPool> m_pool; // staging buffers
+    std::vector<int> m_free;             // buffers not in use
+    struct Job
+    {
+        int buffer;
+        bool checkpoint;   // checkpoint or output step
+        unsigned int step;
+        unsigned long iteration;  // of a checkpoint
+        unsigned int outputSteps; // output steps before a checkpoint
+        StencilStats stats; // of the local array of an output step
+    };
+    std::deque<Job> m_pending; // buffers to write, in step order
+    bool m_stop = false;
+    std::exception_ptr m_error; // exception of the background thread
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    double m_backgroundTime = 0.0;
+    double m_waitTime = 0.0;
+
+    // copy the local array into a free staging buffer for the background
+    // thread
+    void enqueue(const HeatTransfer<Real> &ht, bool checkpoint,
+                 unsigned int step, unsigned long iteration = 0);
+    // one step from a staging buffer
+    void writeBuffer(const Real *data, unsigned int step,
+                     const StencilStats &stats);
+    // Put the decimated T and the region of interest from the local array
+    // T with rows of stride elements, starting at cell (1,1)
+    void putReduced(const Real *T, size_t stride);
+    void putStats(const StencilStats &stats);
+    void writeCheckpoint(const Real *data, const Job &job);
+    void run(); // loop of the background thread
 };
 
 #endif /* IO_H_ */
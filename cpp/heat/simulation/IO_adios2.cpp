@@ -10,18 +10,109 @@
 
 #include "IO.h"
 
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 
 #include <adios2.h>
 
 adios2::ADIOS *ad = nullptr;
 adios2::Engine writer;
-adios2::Variable<double> varT;
 adios2::Variable<unsigned int> varGndx;
+// statistics of every block, indexed by the position of its process
+adios2::Variable<double> varBlockStats[4];
+
+// checkpoints: the local arrays without ghost cells, and the counters
+adios2::IO checkpointIO;
+adios2::Engine checkpointWriter;
+adios2::Variable<unsigned int> varStep;
+adios2::Variable<uint64_t> varIteration;
+adios2::Variable<unsigned int> varOutputSteps;
+
+// the variables of T, in the precision of the simulation
+template <class Real>
+struct TVariables
+{
+    static adios2::Variable<Real> T;
+    static adios2::Variable<Real> decimated;
+    static adios2::Variable<Real> roi;
+    static adios2::Variable<Real> checkpoint;
+};
+template <class Real>
+adios2::Variable<Real> TVariables<Real>::T;
+template <class Real>
+adios2::Variable<Real> TVariables<Real>::decimated;
+template <class Real>
+adios2::Variable<Real> TVariables<Real>::roi;
+template <class Real>
+adios2::Variable<Real> TVariables<Real>::checkpoint;
+
+// the steps in the BP file name, 0 if there is none
+static unsigned int fileSteps(const std::string &name, MPI_Comm comm)
+{
+    adios2::IO io = ad->DeclareIO("RestartOutput");
+    io.SetEngine("BPFile");
+    try
+    {
+        adios2::Engine reader = io.Open(name, adios2::Mode::Read, comm);
+        const size_t steps = reader.Steps();
+        reader.Close();
+        return static_cast<unsigned int>(steps);
+    }
+    catch (std::exception &)
+    {
+        return 0;
+    }
+}
 
-IO::IO(const Settings &s, MPI_Comm comm)
+// global shape, offset and size of the local block of T, with the planes
+// as the slowest dimension in 3D
+static adios2::Dims shapeT(const Settings &s)
 {
+    if (s.threeD)
+        return {s.gndz, s.gndx, s.gndy};
+    return {s.gndx, s.gndy};
+}
+
+static adios2::Dims startT(const Settings &s)
+{
+    if (s.threeD)
+        return {s.offsz, s.offsx, s.offsy};
+    return {s.offsx, s.offsy};
+}
+
+static adios2::Dims countT(const Settings &s)
+{
+    if (s.threeD)
+        return {s.ndz, s.ndx, s.ndy};
+    return {s.ndx, s.ndy};
+}
+
+template <class Real>
+IO<Real>::IO(const Settings &s, MPI_Comm comm) : m_s{s}, m_async{s.async}
+{
+    if (m_async)
+    {
+        // the background thread calls MPI in ADIOS2 while the solver
+        // exchanges ghost cells, so it gets its own communicator
+        int provided;
+        MPI_Query_thread(&provided);
+        if (provided < MPI_THREAD_MULTIPLE)
+        {
+            throw std::runtime_error(
+                "--async needs MPI_THREAD_MULTIPLE from the MPI library");
+        }
+        MPI_Comm_dup(comm, &m_comm);
+        comm = m_comm;
+    }
     ad = new adios2::ADIOS(s.configfile, comm, adios2::DebugON);
 
     adios2::IO io = ad->DeclareIO("SimulationOutput");
@@ -42,39 +133,620 @@ IO::IO(const Settings &s, MPI_Comm comm)
 //        std::cout << "Using " << io.m_EngineType << " engine for output" << std::endl;
     }
 
-    // define T as 2D global array
-    varT = io.DefineVariable<double>(
+    // define T as 2D (3D) global array
+    adios2::Variable<Real> &varT = TVariables<Real>::T;
+    varT = io.DefineVariable<Real>(
         "T",
         // Global dimensions
-        {s.gndx, s.gndy},
+        shapeT(s),
         // starting offset of the local array in the global space
-        {s.offsx, s.offsy},
+        startT(s),
         // local size, could be defined later using SetSelection()
-        {s.ndx, s.ndy});
+        countT(s));
 
-    writer = io.Open(s.outputfile, adios2::Mode::Write, comm);
+    // compression of T from the command line, or from the operations of T
+    // in adios2.xml
+    if (!s.compression.empty())
+    {
+        adios2::Operator op =
+            ad->DefineOperator("OutputCompressor", s.compression);
+        varT.AddOperation(op, adios2::Params(s.compressionParams.begin(),
+                                             s.compressionParams.end()));
+    }
+    if (!varT.Operations().empty())
+    {
+        m_compression = (s.compression.empty() ? std::string("adios2.xml")
+                                               : s.compression);
+        if (!m_async)
+        {
+            // operators compress contiguous blocks, so T is copied out of
+            // the ghosted array
+            m_buffer.resize(s.ndz * s.ndx * s.ndy);
+        }
+    }
+
+    if (s.decimate > 1)
+    {
+        const unsigned int n = s.decimate;
+        TVariables<Real>::decimated = io.DefineVariable<Real>(
+            "Tdecimated", {s.gndx / n, s.gndy / n}, {s.offsx / n, s.offsy / n},
+            {s.ndx / n, s.ndy / n});
+        io.DefineAttribute<unsigned int>("factor", n, "Tdecimated");
+        io.DefineAttribute<std::string>(
+            "method", s.average ? "average" : "sample", "Tdecimated");
+        m_decimated.resize((s.ndx / n) * (s.ndy / n));
+    }
+    if (s.roi)
+    {
+        // the part of the box in the local array, if any
+        const size_t x0 = std::max(s.roiStart[0], s.offsx);
+        const size_t y0 = std::max(s.roiStart[1], s.offsy);
+        const size_t x1 = std::min(s.roiStart[0] + s.roiCount[0],
+                                   s.offsx + s.ndx);
+        const size_t y1 = std::min(s.roiStart[1] + s.roiCount[1],
+                                   s.offsy + s.ndy);
+        const bool inside = (x0 < x1 && y0 < y1);
+        TVariables<Real>::roi = io.DefineVariable<Real>(
+            "Troi", {s.roiCount[0], s.roiCount[1]},
+            {inside ? x0 - s.roiStart[0] : 0, inside ? y0 - s.roiStart[1] : 0},
+            {inside ? x1 - x0 : 0, inside ? y1 - y0 : 0});
+        io.DefineAttribute<unsigned int>("start", s.roiStart, 2, "Troi");
+        if (inside)
+        {
+            m_roiBox[0] = x0 - s.offsx;
+            m_roiBox[1] = y0 - s.offsy;
+            m_roiBox[2] = x1 - x0;
+            m_roiBox[3] = y1 - y0;
+            m_roi.resize(m_roiBox[2] * m_roiBox[3]);
+        }
+    }
+
+    if (s.stats)
+    {
+        const char *names[4] = {"Tmin", "Tmax", "Tmean", "Tchange"};
+        const char *descriptions[4] = {
+            "minimum of T in the block", "maximum of T in the block",
+            "mean of T in the block",
+            "L2 norm of the change of T in the block in the last iteration"};
+        for (int k = 0; k < 4; ++k)
+        {
+            if (s.threeD)
+                varBlockStats[k] = io.DefineVariable<double>(
+                    names[k], {s.npz, s.npx, s.npy}, {s.posz, s.posx, s.posy},
+                    {1, 1, 1});
+            else
+                varBlockStats[k] = io.DefineVariable<double>(
+                    names[k], {s.npx, s.npy}, {s.posx, s.posy}, {1, 1});
+            io.DefineAttribute<std::string>("description", descriptions[k],
+                                            names[k]);
+        }
+        // the cells of T a block covers, if all blocks have the same size
+        if (s.threeD)
+        {
+            const unsigned int blockSize[3] = {s.ndz, s.ndx, s.ndy};
+            io.DefineAttribute<unsigned int>("blocksize", blockSize, 3, "T");
+        }
+        else if (s.UniformBlocks() && !s.rebalance)
+        {
+            const unsigned int blockSize[2] = {s.ndx, s.ndy};
+            io.DefineAttribute<unsigned int>("blocksize", blockSize, 2, "T");
+        }
+    }
+
+    // a restarted run continues its output file, restart() decides which
+    // of the steps in it are written again
+    if (s.restart)
+    {
+        m_fileSteps = fileSteps(s.outputfile, comm);
+    }
+    writer = io.Open(s.outputfile,
+                     s.restart ? adios2::Mode::Append : adios2::Mode::Write,
+                     comm);
 
     // Some optimization:
     // we promise here that we don't change the variables over steps
-    // (the list of variables, their dimensions, and their selections)
-    io.LockDefinitions();
+    // (the list of variables, their dimensions, and their selections),
+    // unless rebalancing moves the blocks
+    if (!s.rebalance)
+    {
+        io.LockDefinitions();
+    }
+
+    if (s.checkpointInterval > 0)
+    {
+        // separate IO, so it can have its own engine in the config file.
+        // It is opened by the first checkpoint, after restart() has read the
+        // last one.
+        checkpointIO = ad->DeclareIO("Checkpoint");
+        if (!checkpointIO.InConfigFile())
+        {
+            checkpointIO.SetEngine("BPFile");
+        }
+        TVariables<Real>::checkpoint = checkpointIO.DefineVariable<Real>(
+            "T", shapeT(s), startT(s), countT(s));
+        varStep = checkpointIO.DefineVariable<unsigned int>("step");
+        varIteration = checkpointIO.DefineVariable<uint64_t>("iteration");
+        varOutputSteps =
+            checkpointIO.DefineVariable<unsigned int>("outputSteps");
+    }
+
+    if (m_async)
+    {
+        // staging buffers are allocated once and recycled
+        m_pool.reset(
+            new StagingPool(s.asyncSteps, s.ndz * s.ndx * s.ndy * sizeof(Real),
+                            s.hugepages));
+        for (unsigned int b = 0; b < s.asyncSteps; ++b)
+        {
+            m_free.push_back(b);
+        }
+        m_thread = std::thread(&IO::run, this);
+    }
 }
 
-IO::~IO()
+template <class Real>
+IO<Real>::~IO()
 {
-    writer.Close();
+    close();
     delete ad;
+    if (m_comm != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&m_comm);
+    }
 }
 
-void IO::write(int step, const HeatTransfer &ht, const Settings &s,
-               MPI_Comm comm)
+template <class Real>
+void IO<Real>::write(int step, const HeatTransfer<Real> &ht,
+                     const Settings &s)
 {
+    ++m_outputSteps;
+    if (m_skipSteps)
+    {
+        // in the output already, from the interrupted run
+        --m_skipSteps;
+        return;
+    }
+    if (m_async)
+    {
+        enqueue(ht, false, step);
+        return;
+    }
+
+    adios2::Variable<Real> &varT = TVariables<Real>::T;
+    const size_t g = ht.ghosts();
+    const bool full = (s.fullEvery && step % s.fullEvery == 0);
+    const double start = MPI_Wtime();
     writer.BeginStep();
-    // using Put() you promise the pointer to the data will be intact
-    // until the end of the output step.
-    // We need to have the vector object here not to destruct here until the end
-    // of function.
-    std::vector<double> v = ht.data_noghost();
-    writer.Put<double>(varT, v.data());
+    putReduced(ht.data() + g * ht.stride() + g, ht.stride());
+    putStats(ht.stats());
+    if (full && !m_buffer.empty())
+    {
+        ht.data_noghost(m_buffer.data());
+        writer.Put<Real>(varT, m_buffer.data());
+    }
+    else if (full)
+    {
+        // Write the local array straight from the simulation: the memory
+        // selection describes the ghosted, padded array in memory and where
+        // the ndx*ndy block starts in it, so there is no copy without ghost
+        // cells. Using Put() you promise the pointer to the data will be
+        // intact until the end of the output step, which is true until the
+        // next iteration.
+        if (s.threeD)
+        {
+            // the plane stride may be padded, so it is a whole number of rows
+            varT.SetMemorySelection(
+                {{g, g, g},
+                 {s.ndz + 2 * g, ht.planeStride() / ht.stride(),
+                  ht.stride()}});
+            writer.Put<Real>(varT, ht.data());
+        }
+        else
+        {
+            varT.SetMemorySelection({{g, g}, {s.ndx + 2 * g, ht.stride()}});
+            writer.Put<Real>(varT, ht.data());
+        }
+    }
     writer.EndStep();
+    if (full)
+    {
+        m_writeTime += MPI_Wtime() - start;
+        m_rawBytes += s.ndz * s.ndx * s.ndy * sizeof(Real);
+        ++m_fullSteps;
+    }
+}
+
+template <class Real>
+void IO<Real>::checkpoint(unsigned int step, unsigned long iteration,
+                          const HeatTransfer<Real> &ht)
+{
+    // Settings turns on async with checkpoints
+    enqueue(ht, true, step, iteration);
+}
+
+template <class Real>
+unsigned int IO<Real>::restart(HeatTransfer<Real> &ht,
+                               unsigned long &iteration, MPI_Comm comm)
+{
+    adios2::IO io = ad->DeclareIO("Restart");
+    if (!io.InConfigFile())
+    {
+        io.SetEngine("BPFile");
+    }
+    adios2::Engine reader =
+        io.Open(m_s.checkpointFile, adios2::Mode::Read, comm);
+    adios2::Variable<Real> vT = io.InquireVariable<Real>("T");
+    adios2::Variable<unsigned int> vStep =
+        io.InquireVariable<unsigned int>("step");
+    adios2::Variable<uint64_t> vIteration =
+        io.InquireVariable<uint64_t>("iteration");
+    adios2::Variable<unsigned int> vOutputSteps =
+        io.InquireVariable<unsigned int>("outputSteps");
+    if (!vT || !vStep || !vIteration || !vOutputSteps)
+    {
+        // also if it was written in the other precision
+        throw std::runtime_error(
+            std::string("No checkpoint in ") +
+            (sizeof(Real) == sizeof(float) ? "float" : "double") + " in " +
+            m_s.checkpointFile);
+    }
+    const adios2::Dims shape = vT.Shape();
+    if (shape != shapeT(m_s))
+    {
+        throw std::invalid_argument(
+            "The checkpoint in " + m_s.checkpointFile +
+            " is not of the global array size of this run");
+    }
+
+    // the last checkpoint, our block of it
+    const size_t last = vT.Steps() - 1;
+    vT.SetStepSelection({last, 1});
+    vT.SetSelection({startT(m_s), countT(m_s)});
+    vStep.SetStepSelection({last, 1});
+    vIteration.SetStepSelection({last, 1});
+    vOutputSteps.SetStepSelection({last, 1});
+    std::vector<Real> block(m_s.ndz * m_s.ndx * m_s.ndy);
+    unsigned int step;
+    uint64_t it;
+    reader.Get(vT, block.data());
+    reader.Get(vStep, step);
+    reader.Get(vIteration, it);
+    reader.Get(vOutputSteps, m_outputSteps);
+    reader.Close();
+    iteration = static_cast<unsigned long>(it);
+
+    // this run computes the same steps after the checkpoint again, so the
+    // ones in the output already are skipped instead of duplicated
+    m_skipSteps = (m_fileSteps > m_outputSteps ? m_fileSteps - m_outputSteps
+                                               : 0);
+
+    ht.set_noghost(block.data());
+    return step;
 }
+
+template <class Real>
+void IO<Real>::readInitial(HeatTransfer<Real> &ht, MPI_Comm comm)
+{
+    // T of the other precision is converted
+    using Other = typename std::conditional<sizeof(Real) == sizeof(double),
+                                            float, double>::type;
+    adios2::IO io = ad->DeclareIO("InitialCondition");
+    if (!io.InConfigFile())
+    {
+        io.SetEngine("BPFile");
+    }
+    adios2::Engine reader = io.Open(m_s.initFile, adios2::Mode::Read, comm);
+    adios2::Variable<Real> vT = io.InquireVariable<Real>("T");
+    adios2::Variable<Other> vOther;
+    if (!vT)
+    {
+        vOther = io.InquireVariable<Other>("T");
+    }
+    if (!vT && !vOther)
+    {
+        throw std::runtime_error("No variable T in " + m_s.initFile);
+    }
+    if ((vT ? vT.Shape() : vOther.Shape()) != shapeT(m_s))
+    {
+        throw std::invalid_argument(
+            "T in " + m_s.initFile +
+            " is not of the global array size of this run");
+    }
+    const size_t steps = (vT ? vT.Steps() : vOther.Steps());
+    if (m_s.initStep >= (int)steps)
+    {
+        throw std::invalid_argument("--init: " + m_s.initFile + " has " +
+                                    std::to_string(steps) + " steps of T");
+    }
+    const size_t step = (m_s.initStep < 0 ? steps - 1 : m_s.initStep);
+
+    // our block of that step
+    const adios2::Box<adios2::Dims> selection(startT(m_s), countT(m_s));
+    std::vector<Real> block(m_s.ndz * m_s.ndx * m_s.ndy);
+    if (vT)
+    {
+        vT.SetStepSelection({step, 1});
+        vT.SetSelection(selection);
+        reader.Get(vT, block.data());
+        reader.Close();
+    }
+    else
+    {
+        std::vector<Other> other(block.size());
+        vOther.SetStepSelection({step, 1});
+        vOther.SetSelection(selection);
+        reader.Get(vOther, other.data());
+        reader.Close();
+        std::copy(other.begin(), other.end(), block.begin());
+    }
+    ht.set_noghost(block.data());
+}
+
+template <class Real>
+void IO<Real>::enqueue(const HeatTransfer<Real> &ht, bool checkpoint,
+                       unsigned int step, unsigned long iteration)
+{
+    // wait for a free staging buffer, then hand the snapshot over
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const double start = MPI_Wtime();
+    m_cond.wait(lock, [this] { return !m_free.empty() || m_error; });
+    m_waitTime += MPI_Wtime() - start;
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+    const int b = m_free.back();
+    m_free.pop_back();
+    lock.unlock();
+
+    ht.data_noghost(m_pool->template buffer<Real>(b));
+
+    lock.lock();
+    m_pending.push_back(
+        {b, checkpoint, step, iteration, m_outputSteps, ht.stats()});
+    lock.unlock();
+    m_cond.notify_all();
+}
+
+template <class Real>
+void IO<Real>::flush()
+{
+    if (!m_async)
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const double start = MPI_Wtime();
+    m_cond.wait(lock, [this] {
+        return m_free.size() == m_pool->size() || m_error;
+    });
+    m_waitTime += MPI_Wtime() - start;
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+}
+
+template <class Real>
+void IO<Real>::resize()
+{
+    TVariables<Real>::T.SetSelection({startT(m_s), countT(m_s)});
+    if (TVariables<Real>::checkpoint)
+    {
+        TVariables<Real>::checkpoint.SetSelection(
+            {startT(m_s), countT(m_s)});
+    }
+    const size_t n = m_s.ndz * m_s.ndx * m_s.ndy;
+    if (!m_buffer.empty())
+    {
+        m_buffer.resize(n);
+    }
+    if (m_async)
+    {
+        // all buffers are free after flush(), so the background thread does
+        // not touch the pool
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pool.reset(new StagingPool(m_s.asyncSteps, n * sizeof(Real),
+                                     m_s.hugepages));
+    }
+}
+
+template <class Real>
+void IO<Real>::close()
+{
+    if (m_closed)
+    {
+        return;
+    }
+    m_closed = true;
+    if (m_async)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+    writer.Close();
+    if (checkpointWriter)
+    {
+        checkpointWriter.Close();
+    }
+}
+
+// bytes of a file, or of all files below a directory
+static size_t diskUsage(const std::string &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st))
+    {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        return st.st_size;
+    }
+    size_t bytes = 0;
+    if (DIR *dir = opendir(path.c_str()))
+    {
+        while (struct dirent *e = readdir(dir))
+        {
+            const std::string name(e->d_name);
+            if (name != "." && name != "..")
+                bytes += diskUsage(path + "/" + name);
+        }
+        closedir(dir);
+    }
+    return bytes;
+}
+
+template <class Real>
+size_t IO<Real>::outputBytes() const
+{
+    // BP3 writes the file and a .dir of subfiles, BP4 a directory
+    return diskUsage(m_s.outputfile) + diskUsage(m_s.outputfile + ".dir");
+}
+
+template <class Real>
+void IO<Real>::writeBuffer(const Real *data, unsigned int step,
+                           const StencilStats &stats)
+{
+    const bool full = (m_s.fullEvery && step % m_s.fullEvery == 0);
+    const double start = MPI_Wtime();
+    writer.BeginStep();
+    putReduced(data, m_s.ndy);
+    putStats(stats);
+    if (full)
+    {
+        writer.Put<Real>(TVariables<Real>::T, data);
+    }
+    writer.EndStep();
+    if (full)
+    {
+        m_writeTime += MPI_Wtime() - start;
+        m_rawBytes += m_s.ndz * m_s.ndx * m_s.ndy * sizeof(Real);
+        ++m_fullSteps;
+    }
+}
+
+template <class Real>
+void IO<Real>::putStats(const StencilStats &stats)
+{
+    if (!m_s.stats)
+    {
+        return;
+    }
+    m_blockStats[0] = stats.min;
+    m_blockStats[1] = stats.max;
+    m_blockStats[2] = stats.sum / stats.cells;
+    m_blockStats[3] = std::sqrt(stats.change2);
+    for (int k = 0; k < 4; ++k)
+    {
+        writer.Put<double>(varBlockStats[k], &m_blockStats[k]);
+    }
+}
+
+template <class Real>
+void IO<Real>::putReduced(const Real *T, size_t stride)
+{
+    if (TVariables<Real>::decimated)
+    {
+        const unsigned int n = m_s.decimate;
+        const size_t nx = m_s.ndx / n;
+        const size_t ny = m_s.ndy / n;
+        for (size_t i = 0; i < nx; ++i)
+        {
+            Real *out = &m_decimated[i * ny];
+            const Real *in = T + i * n * stride;
+            if (!m_s.average)
+            {
+                for (size_t j = 0; j < ny; ++j)
+                    out[j] = in[j * n];
+                continue;
+            }
+            for (size_t j = 0; j < ny; ++j)
+            {
+                // summed in double also for float T
+                double sum = 0.0;
+                for (size_t di = 0; di < n; ++di)
+                    for (size_t dj = 0; dj < n; ++dj)
+                        sum += in[di * stride + j * n + dj];
+                out[j] = sum / (n * n);
+            }
+        }
+        writer.Put<Real>(TVariables<Real>::decimated, m_decimated.data());
+    }
+    if (!m_roi.empty())
+    {
+        for (size_t i = 0; i < m_roiBox[2]; ++i)
+        {
+            std::memcpy(&m_roi[i * m_roiBox[3]],
+                        T + (m_roiBox[0] + i) * stride + m_roiBox[1],
+                        m_roiBox[3] * sizeof(Real));
+        }
+        writer.Put<Real>(TVariables<Real>::roi, m_roi.data());
+    }
+}
+
+template <class Real>
+void IO<Real>::writeCheckpoint(const Real *data, const Job &job)
+{
+    if (!checkpointWriter)
+    {
+        checkpointWriter = checkpointIO.Open(
+            m_s.checkpointFile,
+            m_s.restart ? adios2::Mode::Append : adios2::Mode::Write,
+            m_comm);
+    }
+    const uint64_t iteration = job.iteration;
+    checkpointWriter.BeginStep();
+    checkpointWriter.Put<Real>(TVariables<Real>::checkpoint, data);
+    checkpointWriter.Put<unsigned int>(varStep, job.step);
+    checkpointWriter.Put<uint64_t>(varIteration, iteration);
+    checkpointWriter.Put<unsigned int>(varOutputSteps, job.outputSteps);
+    checkpointWriter.EndStep();
+}
+
+template <class Real>
+void IO<Real>::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_cond.wait(lock, [this] { return !m_pending.empty() || m_stop; });
+        if (m_pending.empty())
+        {
+            return; // stopped with nothing left to write
+        }
+        const Job job = m_pending.front();
+        m_pending.pop_front();
+        lock.unlock();
+
+        const double start = MPI_Wtime();
+        try
+        {
+            if (job.checkpoint)
+                writeCheckpoint(m_pool->template buffer<Real>(job.buffer),
+                                job);
+            else
+                writeBuffer(m_pool->template buffer<Real>(job.buffer), job.step,
+                            job.stats);
+        }
+        catch (...)
+        {
+            lock.lock();
+            m_error = std::current_exception();
+            m_cond.notify_all();
+            return;
+        }
+
+        lock.lock();
+        m_backgroundTime += MPI_Wtime() - start;
+        m_free.push_back(job.buffer);
+        m_cond.notify_all();
+    }
+}
+
+template class IO<double>;
+template class IO<float>;
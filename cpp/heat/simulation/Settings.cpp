@@ -14,6 +14,8 @@
 
 #include <cstdlib>
 
+#include <algorithm>
+#include <numeric>
 #include <stdexcept>
 
 static unsigned int convertToUint(std::string varName, char *arg)
@@ -33,6 +35,34 @@ static unsigned int convertToUint(std::string varName, char *arg)
     return (unsigned int)retval;
 }
 
+static double convertToDouble(std::string varName, char *arg)
+{
+    char *end;
+    double retval = std::strtod(arg, &end);
+    if (end[0] || errno == ERANGE)
+    {
+        throw std::invalid_argument("Invalid value given for " + varName +
+                                    ": " + std::string(arg));
+    }
+    if (retval < 0)
+    {
+        throw std::invalid_argument("Negative value given for " + varName +
+                                    ": " + std::string(arg));
+    }
+    return retval;
+}
+
+// value of the optional argument argv[i], moving i to it
+static char *optionValue(int argc, char *argv[], int &i)
+{
+    if (i + 1 >= argc)
+    {
+        throw std::invalid_argument("Missing value for " +
+                                    std::string(argv[i]));
+    }
+    return argv[++i];
+}
+
 Settings::Settings(int argc, char *argv[], int rank, int nproc) : rank{rank}
 {
     if (argc < 8)
@@ -50,37 +80,585 @@ Settings::Settings(int argc, char *argv[], int rank, int nproc) : rank{rank}
     steps = convertToUint("steps", argv[6]);
     iterations = convertToUint("iterations", argv[7]);
 
-    if (npx * npy != this->nproc)
+    for (int i = 8; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--tblock")
+        {
+            tblock = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--verify")
+        {
+            verify = true;
+        }
+        else if (arg == "--exchange")
+        {
+            const std::string mode(optionValue(argc, argv, i));
+            if (mode == "blocking")
+                exchange = ExchangeMode::Blocking;
+            else if (mode == "nonblocking")
+                exchange = ExchangeMode::NonBlocking;
+            else if (mode == "persistent")
+                exchange = ExchangeMode::Persistent;
+            else if (mode == "neighbor")
+                exchange = ExchangeMode::Neighbor;
+            else if (mode == "shared")
+                exchange = ExchangeMode::Shared;
+            else
+                throw std::invalid_argument("Invalid value given for " + arg +
+                                            ": " + mode);
+        }
+        else if (arg == "--overlap")
+        {
+            overlap = true;
+        }
+        else if (arg == "--cart")
+        {
+            cart = true;
+        }
+        else if (arg == "--periodic")
+        {
+            periodic = true;
+        }
+        else if (arg == "--threads")
+        {
+            threads = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--pin")
+        {
+            pin = true;
+        }
+        else if (arg == "--async")
+        {
+            async = true;
+        }
+        else if (arg == "--async-steps")
+        {
+            asyncSteps = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--hugepages")
+        {
+            hugepages = true;
+        }
+        else if (arg == "--checkpoint")
+        {
+            checkpointInterval =
+                convertToDouble(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--checkpoint-file")
+        {
+            checkpointFile = optionValue(argc, argv, i);
+        }
+        else if (arg == "--restart")
+        {
+            restart = true;
+        }
+        else if (arg == "--compress")
+        {
+            SetCompression(optionValue(argc, argv, i));
+        }
+        else if (arg == "--decimate" || arg == "--average")
+        {
+            decimate = convertToUint(arg, optionValue(argc, argv, i));
+            average = (arg == "--average");
+        }
+        else if (arg == "--roi")
+        {
+            SetRegion(optionValue(argc, argv, i));
+        }
+        else if (arg == "--full-every")
+        {
+            fullEvery = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--stats")
+        {
+            stats = true;
+        }
+        else if (arg == "--tolerance")
+        {
+            tolerance = convertToDouble(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--check-every")
+        {
+            checkEvery = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--residual")
+        {
+            const std::string norm(optionValue(argc, argv, i));
+            if (norm == "max")
+                residualL2 = false;
+            else if (norm == "l2")
+                residualL2 = true;
+            else
+                throw std::invalid_argument("Invalid value given for " + arg +
+                                            ": " + norm);
+        }
+        else if (arg == "--converged-every")
+        {
+            convergedEvery = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--precision")
+        {
+            const std::string precision(optionValue(argc, argv, i));
+            if (precision == "double")
+                singlePrecision = false;
+            else if (precision == "float")
+                singlePrecision = true;
+            else
+                throw std::invalid_argument("Invalid value given for " + arg +
+                                            ": " + precision);
+        }
+        else if (arg == "--solver")
+        {
+            const std::string name(optionValue(argc, argv, i));
+            if (name == "jacobi")
+                solver = SolverType::Jacobi;
+            else if (name == "cg")
+                solver = SolverType::CG;
+            else if (name == "multigrid")
+                solver = SolverType::Multigrid;
+            else
+                throw std::invalid_argument("Invalid value given for " + arg +
+                                            ": " + name);
+        }
+        else if (arg == "--smoothing")
+        {
+            smoothing = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--3d")
+        {
+            SetVolume(optionValue(argc, argv, i));
+        }
+        else if (arg == "--blocks")
+        {
+            SetBlocks(optionValue(argc, argv, i));
+        }
+        else if (arg == "--init")
+        {
+            SetInit(optionValue(argc, argv, i));
+        }
+        else if (arg == "--rebalance")
+        {
+            rebalance = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
+    }
+
+    if (checkpointFile.empty())
+    {
+        checkpointFile = outputfile + ".ckpt";
+    }
+    if (checkpointInterval > 0)
+    {
+        // checkpoints are written by the background thread of async output
+        async = true;
+    }
+
+    if (npx * npy * npz != this->nproc)
+    {
+        throw std::invalid_argument(
+            threeD ? "N*M*P of --3d must equal the number of processes"
+                   : "N*M must equal the number of processes");
+    }
+
+    if (blockx.empty())
+    {
+        blockx.assign(npx, ndx);
+        blocky.assign(npy, ndy);
+    }
+    else if (blockx.size() != npx || blocky.size() != npy)
+    {
+        throw std::invalid_argument(
+            "--blocks needs N sizes in X and M sizes in Y");
+    }
+    // the smallest block decides
+    const unsigned int minx = *std::min_element(blockx.begin(), blockx.end());
+    const unsigned int miny = *std::min_element(blocky.begin(), blocky.end());
+    if (tblock < 1 || tblock > minx || tblock > miny ||
+        (threeD && tblock > ndz))
+    {
+        throw std::invalid_argument(
+            threeD ? "--tblock must be between 1 and the local array sizes "
+                     "nx, ny and nz"
+                   : "--tblock must be between 1 and the local array sizes "
+                     "nx and ny");
+    }
+    if (threeD &&
+        (overlap || solver != SolverType::Jacobi || decimate > 1 || roi ||
+         exchange == ExchangeMode::Persistent ||
+         exchange == ExchangeMode::Neighbor ||
+         exchange == ExchangeMode::Shared))
+    {
+        // those work on the planes of the 2D arrays only
+        throw std::invalid_argument(
+            "--3d cannot be used with --overlap, --solver, --decimate, "
+            "--average, --roi or --exchange persistent|neighbor|shared");
+    }
+    if ((threeD || exchange == ExchangeMode::Shared ||
+         solver == SolverType::Multigrid) &&
+        (rebalance || !UniformBlocks()))
+    {
+        // those assume the same block size on all processes
+        throw std::invalid_argument(
+            "--blocks and --rebalance cannot be used with --3d, --exchange "
+            "shared or --solver multigrid");
+    }
+    if (rebalance && (solver != SolverType::Jacobi || decimate > 1 || roi))
+    {
+        // the solvers and the reduced output are set up for fixed blocks
+        throw std::invalid_argument("--rebalance cannot be used with "
+                                    "--solver, --decimate, --average or "
+                                    "--roi");
+    }
+    if (overlap && exchange == ExchangeMode::Blocking)
+    {
+        throw std::invalid_argument(
+            "--overlap needs a non-blocking --exchange mode");
+    }
+    if (overlap && tblock > 1)
+    {
+        throw std::invalid_argument("--overlap cannot be used with --tblock");
+    }
+    if (solver != SolverType::Jacobi &&
+        (tblock > 1 || overlap || verify || tolerance > 0))
+    {
+        // those are properties of the Jacobi relaxation
+        throw std::invalid_argument("--solver cg and multigrid cannot be used "
+                                    "with --tblock, --overlap, --verify or "
+                                    "--tolerance");
+    }
+    if (init == InitType::File && restart)
+    {
+        throw std::invalid_argument("--init file cannot be used with "
+                                    "--restart");
+    }
+    if (asyncSteps < 1)
+    {
+        throw std::invalid_argument("--async-steps must be at least 1");
+    }
+    if (checkEvery < 1)
+    {
+        throw std::invalid_argument("--check-every must be at least 1");
+    }
+    if (threads < 1)
+    {
+        throw std::invalid_argument("--threads must be at least 1");
+    }
+#ifndef _OPENMP
+    if (threads > 1)
+    {
+        throw std::invalid_argument(
+            "--threads needs heatSimulation built with OpenMP");
+    }
+#endif
+    if (exchange == ExchangeMode::Neighbor && !cart)
+    {
+        throw std::invalid_argument("--exchange neighbor needs --cart");
+    }
+    if (periodic && exchange == ExchangeMode::Blocking)
+    {
+        // every process would send before it receives in a ring
+        throw std::invalid_argument(
+            "--periodic needs a non-blocking --exchange mode");
+    }
+    if (periodic && exchange == ExchangeMode::Neighbor &&
+        (npx < 3 || npy < 3))
+    {
+        // both neighbors in a dimension are the same process, and MPI
+        // implementations do not agree on how those messages are matched
+        throw std::invalid_argument("--periodic with --exchange neighbor "
+                                    "needs at least 3 processes in X and Y");
+    }
+
+    const auto indivisible = [this](unsigned int n) {
+        return n % decimate != 0;
+    };
+    if (decimate < 1 ||
+        std::any_of(blockx.begin(), blockx.end(), indivisible) ||
+        std::any_of(blocky.begin(), blocky.end(), indivisible))
     {
-        throw std::invalid_argument("N*M must equal the number of processes");
+        // every process writes whole cells of the decimated array
+        throw std::invalid_argument(
+            "--decimate and --average must divide nx and ny");
     }
 
     // calculate global array size and the local offsets in that global space
-    gndx = npx * ndx;
-    gndy = npy * ndy;
+    gndx = std::accumulate(blockx.begin(), blockx.end(), 0u);
+    gndy = std::accumulate(blocky.begin(), blocky.end(), 0u);
+    gndz = npz * ndz;
+
+    if (!fullEvery && decimate == 1 && !roi)
+    {
+        throw std::invalid_argument(
+            "--full-every 0 needs --decimate, --average or --roi");
+    }
+    if (roi && (roiStart[0] + roiCount[0] > gndx ||
+                roiStart[1] + roiCount[1] > gndy))
+    {
+        throw std::invalid_argument("--roi is outside of the global array");
+    }
     posx = rank % npx;
-    posy = rank / npx;
-    offsx = posx * ndx;
-    offsy = posy * ndy;
+    posy = rank / npx % npy;
+    posz = rank / (npx * npy);
+    SetOffsets();
+    offsz = posz * ndz;
+
+    SetNeighbors();
+}
+
+void Settings::Resize(const std::vector<unsigned int> &bx,
+                      const std::vector<unsigned int> &by)
+{
+    blockx = bx;
+    blocky = by;
+    SetOffsets();
+}
+
+bool Settings::UniformBlocks() const
+{
+    return std::count(blockx.begin(), blockx.end(), blockx[0]) ==
+               (ptrdiff_t)blockx.size() &&
+           std::count(blocky.begin(), blocky.end(), blocky[0]) ==
+               (ptrdiff_t)blocky.size();
+}
+
+void Settings::SetOffsets()
+{
+    ndx = blockx[posx];
+    ndy = blocky[posy];
+    offsx = std::accumulate(blockx.begin(), blockx.begin() + posx, 0u);
+    offsy = std::accumulate(blocky.begin(), blocky.begin() + posy, 0u);
+}
+
+void Settings::SetCompression(const std::string &spec)
+{
+    // type[:key=value[,key=value...]]
+    const size_t colon = spec.find(':');
+    compression = spec.substr(0, colon);
+    if (compression != "zfp" && compression != "sz" && compression != "blosc")
+    {
+        throw std::invalid_argument("Unknown compressor for --compress: " +
+                                    compression);
+    }
+    size_t pos = (colon == std::string::npos ? spec.size() : colon + 1);
+    while (pos < spec.size())
+    {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos)
+            end = spec.size();
+        const std::string param = spec.substr(pos, end - pos);
+        const size_t eq = param.find('=');
+        if (eq == std::string::npos || eq == 0 || eq + 1 == param.size())
+        {
+            throw std::invalid_argument("Invalid parameter for --compress: " +
+                                        param);
+        }
+        compressionParams[param.substr(0, eq)] = param.substr(eq + 1);
+        pos = end + 1;
+    }
+    if ((compression == "zfp" && compressionParams.empty()) ||
+        (compression == "sz" && !compressionParams.count("accuracy")))
+    {
+        // the lossy compressors have no default error bound
+        throw std::invalid_argument(
+            "--compress " + compression +
+            " needs an error bound, e.g. " + compression +
+            ":accuracy=0.0001");
+    }
+}
 
+void Settings::SetRegion(const std::string &spec)
+{
+    // x,y,nx,ny
+    unsigned int values[4];
+    size_t pos = 0;
+    for (int k = 0; k < 4; ++k)
+    {
+        const size_t end = (k < 3 ? spec.find(',', pos) : spec.size());
+        if (end == std::string::npos)
+        {
+            throw std::invalid_argument("--roi needs x,y,nx,ny: " + spec);
+        }
+        std::string value = spec.substr(pos, end - pos);
+        values[k] = convertToUint("--roi", &value[0]);
+        pos = end + 1;
+    }
+    if (!values[2] || !values[3])
+    {
+        throw std::invalid_argument("--roi cannot be empty: " + spec);
+    }
+    roi = true;
+    roiStart[0] = values[0];
+    roiStart[1] = values[1];
+    roiCount[0] = values[2];
+    roiCount[1] = values[3];
+}
+
+void Settings::SetVolume(const std::string &spec)
+{
+    // P,nz
+    const size_t comma = spec.find(',');
+    if (comma == std::string::npos)
+    {
+        throw std::invalid_argument("--3d needs P,nz: " + spec);
+    }
+    std::string p = spec.substr(0, comma);
+    std::string n = spec.substr(comma + 1);
+    npz = convertToUint("P", &p[0]);
+    ndz = convertToUint("nz", &n[0]);
+    if (!npz || !ndz)
+    {
+        throw std::invalid_argument("--3d cannot be empty: " + spec);
+    }
+    threeD = true;
+}
+
+void Settings::SetBlocks(const std::string &spec)
+{
+    // x1,...,xN:y1,...,yM
+    const size_t colon = spec.find(':');
+    if (colon == std::string::npos)
+    {
+        throw std::invalid_argument("--blocks needs x1,...,xN:y1,...,yM: " +
+                                    spec);
+    }
+    std::vector<unsigned int> *sizes[2] = {&blockx, &blocky};
+    const std::string lists[2] = {spec.substr(0, colon),
+                                  spec.substr(colon + 1)};
+    for (int d = 0; d < 2; ++d)
+    {
+        sizes[d]->clear();
+        size_t pos = 0;
+        while (pos <= lists[d].size())
+        {
+            size_t end = lists[d].find(',', pos);
+            if (end == std::string::npos)
+                end = lists[d].size();
+            std::string value = lists[d].substr(pos, end - pos);
+            const unsigned int n = convertToUint("--blocks", &value[0]);
+            if (!n)
+            {
+                throw std::invalid_argument("--blocks cannot be empty: " +
+                                            spec);
+            }
+            sizes[d]->push_back(n);
+            pos = end + 1;
+        }
+    }
+}
+
+void Settings::SetInit(const std::string &spec)
+{
+    // analytic | random[:seed] | file:name[:step]
+    const size_t colon = spec.find(':');
+    const std::string type = spec.substr(0, colon);
+    std::string rest =
+        (colon == std::string::npos ? std::string() : spec.substr(colon + 1));
+    if (type == "analytic" && rest.empty())
+    {
+        init = InitType::Analytic;
+    }
+    else if (type == "random")
+    {
+        init = InitType::Random;
+        if (!rest.empty())
+            initSeed = convertToUint("--init random", &rest[0]);
+    }
+    else if (type == "file" && !rest.empty())
+    {
+        init = InitType::File;
+        // the step is a number after the last colon, the rest is the name
+        const size_t last = rest.rfind(':');
+        std::string step =
+            (last == std::string::npos ? std::string() : rest.substr(last + 1));
+        if (!step.empty() &&
+            step.find_first_not_of("0123456789") == std::string::npos)
+        {
+            initStep = convertToUint("--init file", &step[0]);
+            rest.resize(last);
+        }
+        initFile = rest;
+    }
+    else
+    {
+        throw std::invalid_argument(
+            "--init needs analytic, random[:seed] or file:name[:step]: " +
+            spec);
+    }
+}
+
+void Settings::SetNeighbors()
+{
     // determine neighbors
     if (posx == 0)
-        rank_up = -1;
+        rank_up = (periodic ? rank + npx - 1 : -1);
     else
         rank_up = rank - 1;
 
     if (posx == npx - 1)
-        rank_down = -1;
+        rank_down = (periodic ? rank - npx + 1 : -1);
     else
         rank_down = rank + 1;
 
     if (posy == 0)
-        rank_left = -1;
+        rank_left = (periodic ? rank + (npy - 1) * npx : -1);
     else
         rank_left = rank - npx;
 
     if (posy == npy - 1)
-        rank_right = -1;
+        rank_right = (periodic ? rank - (npy - 1) * npx : -1);
     else
         rank_right = rank + npx;
+
+    if (!threeD)
+        return;
+    const int plane = npx * npy;
+    if (posz == 0)
+        rank_front = (periodic ? rank + (npz - 1) * plane : -1);
+    else
+        rank_front = rank - plane;
+
+    if (posz == npz - 1)
+        rank_back = (periodic ? rank - (npz - 1) * plane : -1);
+    else
+        rank_back = rank + plane;
+}
+
+MPI_Comm Settings::CreateCartComm(MPI_Comm comm)
+{
+    // X is the fast dimension of the rank numbering, so it is the last
+    // dimension of the (row-major) cartesian grid, after Z and Y in 3D
+    const int ndims = (threeD ? 3 : 2);
+    const int d = ndims - 2; // dimension of Y
+    int dims[3] = {(int)npz, (int)npy, (int)npx};
+    int periods[3] = {periodic, periodic, periodic};
+    MPI_Comm cartComm;
+    MPI_Cart_create(comm, ndims, dims + 1 - d, periods, 1, &cartComm);
+
+    int coords[3];
+    MPI_Comm_rank(cartComm, &rank);
+    MPI_Cart_coords(cartComm, rank, ndims, coords);
+    posz = (threeD ? coords[0] : 0);
+    posy = coords[d];
+    posx = coords[d + 1];
+    SetOffsets();
+    offsz = posz * ndz;
+
+    if (threeD)
+        MPI_Cart_shift(cartComm, 0, 1, &rank_front, &rank_back);
+    MPI_Cart_shift(cartComm, d, 1, &rank_left, &rank_right);
+    MPI_Cart_shift(cartComm, d + 1, 1, &rank_up, &rank_down);
+    int *neighbors[6] = {&rank_left, &rank_right, &rank_up,
+                         &rank_down, &rank_front, &rank_back};
+    for (int *n : neighbors)
+    {
+        if (*n == MPI_PROC_NULL)
+        {
+            *n = -1;
+        }
+    }
+    return cartComm;
 }
@@ -11,7 +11,38 @@
 #ifndef SETTINGS_H_
 #define SETTINGS_H_
 
+#include <mpi.h>
+
+#include <map>
 #include <string>
+#include <vector>
+
+// How ghost cells are exchanged with the neighbors
+enum class ExchangeMode
+{
+    Blocking,    // MPI_Send/MPI_Recv, one direction after the other
+    NonBlocking, // MPI_Isend/MPI_Irecv, all directions at once
+    Persistent,  // persistent requests on derived datatypes, no packing
+    Neighbor,    // MPI_Neighbor_alltoallw on a cartesian communicator
+    Shared       // copy directly from neighbors on the same node through
+                 // MPI-3 shared memory windows, non-blocking to the others
+};
+
+// How the steady state is approached in the iterations of a step
+enum class SolverType
+{
+    Jacobi,   // weighted Jacobi relaxation of HeatTransfer
+    CG,       // conjugate gradients, one iteration per iteration
+    Multigrid // geometric multigrid, one V-cycle per iteration
+};
+
+// Initial values of T
+enum class InitType
+{
+    Analytic, // sum of waves in each dimension, normalized to [0..200]
+    Random,   // uniform in [0..200], from a seed
+    File      // T of a step of an ADIOS2 file, e.g. an earlier output
+};
 
 class Settings
 {
@@ -24,20 +55,35 @@ public:
     unsigned int npy;        // Number of processes in Y (fast) dimension
     unsigned int ndx;        // Local array size in X dimension per process
     unsigned int ndy;        // Local array size in y dimension per process
+    // block sizes of all processes (--blocks, rebalancing): the rows of the
+    // processes at each position in X and the columns of those at each
+    // position in Y, all nx and ny by default; ndx and ndy are the entries
+    // of this process, offsx and offsy their prefix sums
+    std::vector<unsigned int> blockx;
+    std::vector<unsigned int> blocky;
     unsigned int steps;      // Number of output steps
     unsigned int iterations; // Number of computing iterations between steps
+    // 3D volume (--3d): npz x ndz planes of the ndx x ndy arrays in a third,
+    // slowest dimension Z, computed with a 7-point stencil
+    bool threeD = false;
+    unsigned int npz = 1; // Number of processes in Z dimension
+    unsigned int ndz = 1; // Local array size in Z dimension per process
 
     // calculated values from those arguments and number of processes
     unsigned int gndx; // Global array size in slow dimension
     unsigned int gndy; // Global array size in fast dimension
+    unsigned int gndz = 1; // Global array size in Z dimension
     // X dim positions: rank 0, npx, 2npx... are in the same X position
     // Y dim positions: npx number of consecutive processes belong to one row
     // (npx
     // columns)
+    // Z dim positions: npx*npy consecutive processes belong to one plane
     unsigned int posx;  // Position of this process in X dimension
     unsigned int posy;  // Position of this process in Y dimension
+    unsigned int posz = 0; // Position of this process in Z dimension
     unsigned int offsx; // Offset of local array in X dimension on this process
     unsigned int offsy; // Offset of local array in Y dimension on this process
+    unsigned int offsz = 0; // Offset of local array in Z dimension
 
     int rank;           // MPI rank
     unsigned int nproc; // number of processors
@@ -47,11 +93,98 @@ public:
     int rank_right;
     int rank_up;
     int rank_down;
+    int rank_front = -1; // previous plane in Z
+    int rank_back = -1;  // next plane in Z
 
-    /** true: std::async Write, false (default): sync */
+    /** true: asynchronous Write in a background thread, false (default):
+     * sync */
     bool async = false;
+    unsigned int asyncSteps = 2; // Output steps in flight with async
+    bool hugepages = false;      // Staging buffers of async in huge pages
+
+    double checkpointInterval = 0; // Seconds between checkpoints, 0: none
+    std::string checkpointFile;    // Checkpoint file, default: output.ckpt
+    bool restart = false;          // Start from the last checkpoint
+
+    // ADIOS2 operator type for the output of T (zfp, sz or blosc), empty for
+    // none, and its parameters (e.g. accuracy, rate, clevel)
+    std::string compression;
+    std::map<std::string, std::string> compressionParams;
+
+    // reduced output: T at every decimate-th cell in both dimensions (or
+    // the mean of decimate x decimate blocks), and T in a global box
+    unsigned int decimate = 1;
+    bool average = false;
+    bool roi = false;
+    unsigned int roiStart[2]; // global offset of the box
+    unsigned int roiCount[2]; // size of the box
+    unsigned int fullEvery = 1; // full T every this many steps, 0: never
+    bool stats = false; // Output min/max/mean/change of every block
+
+    // convergence: stop when the change of T in one iteration (its maximum,
+    // or its L2 norm) falls below tolerance, checked every checkEvery
+    // iterations; with convergedEvery > 0 continue but output only every
+    // convergedEvery-th step instead
+    double tolerance = 0;
+    unsigned int checkEvery = 10;
+    bool residualL2 = false;
+    unsigned int convergedEvery = 0;
+
+    // initial condition (--init); the file and its step (the last if -1),
+    // or the seed of the random values
+    InitType init = InitType::Analytic;
+    std::string initFile;
+    int initStep = -1;
+    unsigned long initSeed = 1;
+
+    // store T, compute the stencil and write the output in float instead
+    // of double (statistics and reductions stay in double)
+    bool singlePrecision = false;
+
+    SolverType solver = SolverType::Jacobi;
+    unsigned int smoothing = 2; // Jacobi sweeps before and after the coarse
+                                // grid correction of a V-cycle
+
+    // optional arguments
+    unsigned int tblock = 1; // Iterations fused into one sweep between two
+                             // exchanges (temporal blocking), also the
+                             // number of ghost cell layers
+    bool verify = false;     // Compare the results with a non-blocked run
+    ExchangeMode exchange = ExchangeMode::Blocking;
+    bool overlap = false; // Compute the interior while ghost cells are in
+                          // flight (needs a non-blocking exchange)
+    bool cart = false;     // Create the process grid with MPI_Cart_create
+    bool periodic = false; // Periodic plate in both dimensions (no edges)
+    unsigned int threads = 1; // OpenMP threads per process
+    bool pin = false;         // Pin each thread to its own core
+    unsigned int rebalance = 0; // Resize the blocks to the measured speed of
+                                // the processes every this many output
+                                // steps, 0: never
 
     Settings(int argc, char *argv[], int rank, int nproc);
+
+    /* Create a cartesian communicator for the process grid, letting MPI
+     * reorder the processes to fit the machine, and update the rank,
+     * position, offsets and neighbors to the new communicator.
+     * @return the new communicator
+     */
+    MPI_Comm CreateCartComm(MPI_Comm comm);
+
+    // Change the block sizes of all processes (rebalancing), updating the
+    // size and offsets of this process; the global size stays the same
+    void Resize(const std::vector<unsigned int> &bx,
+                const std::vector<unsigned int> &by);
+    // true if all processes have blocks of the same size
+    bool UniformBlocks() const;
+
+private:
+    void SetNeighbors(); // neighbors from posx/posy in the default layout
+    void SetCompression(const std::string &spec); // parse --compress
+    void SetRegion(const std::string &spec);      // parse --roi
+    void SetVolume(const std::string &spec);      // parse --3d
+    void SetBlocks(const std::string &spec);      // parse --blocks
+    void SetInit(const std::string &spec);        // parse --init
+    void SetOffsets(); // ndx, ndy, offsx, offsy from the blocks and position
 };
 
 #endif /* SETTINGS_H_ */
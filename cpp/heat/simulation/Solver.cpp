@@ -0,0 +1,600 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Solver.cpp
+ *
+ * The Jacobi relaxation converges to the solution of the discrete Laplace
+ * equation 4*T(i,j) - T(i-1,j) - T(i+1,j) - T(i,j-1) - T(i,j+1) = 0 with
+ * the edge temperature in the ghost cells of the global edges. These
+ * solvers compute the same solution with far fewer passes over the arrays.
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "Solver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+// tags of the ghost cell messages, by the direction they are sent in
+const int TagLeft = 31;
+const int TagRight = 32;
+const int TagUp = 33;
+const int TagDown = 34;
+
+/* One level of a grid hierarchy: nx x ny cells with one layer of ghost
+ * cells around them, rows of ny+2 elements. A distributed level is the
+ * block of this process of a global grid and gets its ghost cells from the
+ * neighbors. A serial level is a whole global grid, held by every process.
+ */
+struct Level
+{
+    unsigned int nx;
+    unsigned int ny;
+    bool distributed;
+    // Distance of the global edges from the centers of the cells next to
+    // them, in cells of this level. On the finest level the edges are the
+    // ghost cells (1), on coarser levels they are between the ghost cells
+    // and the first cells.
+    double edge;
+    // true if the ghost cells of the global edges of u hold the edge
+    // temperature, false if u is a correction that is 0 at the edges
+    bool fixedEdges;
+    std::vector<double> u; // solution or correction
+    std::vector<double> f; // right-hand side
+    std::vector<double> r; // residual
+
+    Level(unsigned int nx, unsigned int ny, bool distributed, double edge,
+          bool fixedEdges)
+    : nx{nx}, ny{ny}, distributed{distributed}, edge{edge},
+      fixedEdges{fixedEdges}, u((nx + 2) * (ny + 2), 0.0), f(u.size(), 0.0),
+      r(u.size(), 0.0)
+    {
+    }
+    size_t stride() const { return ny + 2; };
+    double *row(std::vector<double> &v, unsigned int i)
+    {
+        return &v[i * stride()];
+    };
+};
+
+/* Conjugate gradient iteration on a level */
+struct CGState
+{
+    std::vector<double> p;
+    std::vector<double> q;
+    double rr = 0.0;
+};
+
+/* Operations on the levels shared by the solvers */
+class LevelSolver : public Solver
+{
+public:
+    LevelSolver(const Settings &s, MPI_Comm comm) : m_s{s}, m_comm{comm} {}
+
+protected:
+    const Settings &m_s;
+    MPI_Comm m_comm;
+    std::vector<double> m_sendLeft, m_sendRight, m_recvLeft, m_recvRight;
+
+    // fill the ghost cells of v: from the neighbors, and at the global
+    // edges with the value that makes a correction 0 at the edge
+    void halo(Level &L, std::vector<double> &v, bool correction);
+    void exchangeColumns(Level &L, std::vector<double> &v);
+    void exchangeRows(Level &L, std::vector<double> &v);
+    // y = A x in the cells of L, x needs valid ghost cells
+    void apply(Level &L, std::vector<double> &x, std::vector<double> &y);
+    // r = f - A u
+    void residual(Level &L);
+    double dot(Level &L, std::vector<double> &a, std::vector<double> &b);
+    void cgStart(Level &L, CGState &cg);
+    void cgIterate(Level &L, CGState &cg, unsigned int iterations,
+                   double tolerance);
+    // copy T of ht (with ghost cells) into u of the finest level L, and back
+    template <class Real>
+    void load(Level &L, const HeatTransfer<Real> &ht);
+    template <class Real>
+    void store(Level &L, HeatTransfer<Real> &ht);
+};
+
+void LevelSolver::halo(Level &L, std::vector<double> &v, bool correction)
+{
+    // columns first, then whole rows including the ghost columns, so the
+    // corners are valid too
+    const bool edges[4] = {
+        !m_s.periodic && (!L.distributed || m_s.rank_left < 0),
+        !m_s.periodic && (!L.distributed || m_s.rank_right < 0),
+        !m_s.periodic && (!L.distributed || m_s.rank_up < 0),
+        !m_s.periodic && (!L.distributed || m_s.rank_down < 0)};
+    // linear extrapolation to 0 at the edge
+    const double w = (L.edge - 1.0) / L.edge;
+
+    if (L.distributed)
+    {
+        exchangeColumns(L, v);
+    }
+    else if (m_s.periodic)
+    {
+        for (unsigned int i = 1; i <= L.nx; ++i)
+        {
+            double *t = L.row(v, i);
+            t[0] = t[L.ny];
+            t[L.ny + 1] = t[1];
+        }
+    }
+    if (correction)
+    {
+        for (unsigned int i = 1; i <= L.nx; ++i)
+        {
+            double *t = L.row(v, i);
+            if (edges[0])
+                t[0] = w * t[1];
+            if (edges[1])
+                t[L.ny + 1] = w * t[L.ny];
+        }
+    }
+
+    if (L.distributed)
+    {
+        exchangeRows(L, v);
+    }
+    else if (m_s.periodic)
+    {
+        std::copy_n(L.row(v, L.nx), L.stride(), L.row(v, 0));
+        std::copy_n(L.row(v, 1), L.stride(), L.row(v, L.nx + 1));
+    }
+    if (correction)
+    {
+        for (unsigned int j = 0; j < L.stride(); ++j)
+        {
+            if (edges[2])
+                L.row(v, 0)[j] = w * L.row(v, 1)[j];
+            if (edges[3])
+                L.row(v, L.nx + 1)[j] = w * L.row(v, L.nx)[j];
+        }
+    }
+}
+
+void LevelSolver::exchangeColumns(Level &L, std::vector<double> &v)
+{
+    m_sendLeft.resize(L.nx);
+    m_sendRight.resize(L.nx);
+    m_recvLeft.resize(L.nx);
+    m_recvRight.resize(L.nx);
+    for (unsigned int i = 1; i <= L.nx; ++i)
+    {
+        m_sendLeft[i - 1] = L.row(v, i)[1];
+        m_sendRight[i - 1] = L.row(v, i)[L.ny];
+    }
+    MPI_Request requests[4];
+    int n = 0;
+    if (m_s.rank_left >= 0)
+    {
+        MPI_Irecv(m_recvLeft.data(), L.nx, MPI_DOUBLE, m_s.rank_left,
+                  TagRight, m_comm, &requests[n++]);
+        MPI_Isend(m_sendLeft.data(), L.nx, MPI_DOUBLE, m_s.rank_left, TagLeft,
+                  m_comm, &requests[n++]);
+    }
+    if (m_s.rank_right >= 0)
+    {
+        MPI_Irecv(m_recvRight.data(), L.nx, MPI_DOUBLE, m_s.rank_right,
+                  TagLeft, m_comm, &requests[n++]);
+        MPI_Isend(m_sendRight.data(), L.nx, MPI_DOUBLE, m_s.rank_right,
+                  TagRight, m_comm, &requests[n++]);
+    }
+    MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+    for (unsigned int i = 1; i <= L.nx; ++i)
+    {
+        if (m_s.rank_left >= 0)
+            L.row(v, i)[0] = m_recvLeft[i - 1];
+        if (m_s.rank_right >= 0)
+            L.row(v, i)[L.ny + 1] = m_recvRight[i - 1];
+    }
+}
+
+void LevelSolver::exchangeRows(Level &L, std::vector<double> &v)
+{
+    const int n = L.stride();
+    MPI_Request requests[4];
+    int nreq = 0;
+    if (m_s.rank_up >= 0)
+    {
+        MPI_Irecv(L.row(v, 0), n, MPI_DOUBLE, m_s.rank_up, TagDown, m_comm,
+                  &requests[nreq++]);
+        MPI_Isend(L.row(v, 1), n, MPI_DOUBLE, m_s.rank_up, TagUp, m_comm,
+                  &requests[nreq++]);
+    }
+    if (m_s.rank_down >= 0)
+    {
+        MPI_Irecv(L.row(v, L.nx + 1), n, MPI_DOUBLE, m_s.rank_down, TagUp,
+                  m_comm, &requests[nreq++]);
+        MPI_Isend(L.row(v, L.nx), n, MPI_DOUBLE, m_s.rank_down, TagDown,
+                  m_comm, &requests[nreq++]);
+    }
+    MPI_Waitall(nreq, requests, MPI_STATUSES_IGNORE);
+}
+
+void LevelSolver::apply(Level &L, std::vector<double> &x,
+                        std::vector<double> &y)
+{
+    for (unsigned int i = 1; i <= L.nx; ++i)
+    {
+        const double *up = L.row(x, i - 1);
+        const double *mid = L.row(x, i);
+        const double *down = L.row(x, i + 1);
+        double *out = L.row(y, i);
+        for (unsigned int j = 1; j <= L.ny; ++j)
+        {
+            out[j] = 4.0 * mid[j] - up[j] - down[j] - mid[j - 1] - mid[j + 1];
+        }
+    }
+}
+
+void LevelSolver::residual(Level &L)
+{
+    halo(L, L.u, !L.fixedEdges);
+    apply(L, L.u, L.r);
+    for (unsigned int i = 1; i <= L.nx; ++i)
+    {
+        const double *f = L.row(L.f, i);
+        double *r = L.row(L.r, i);
+        for (unsigned int j = 1; j <= L.ny; ++j)
+            r[j] = f[j] - r[j];
+    }
+}
+
+double LevelSolver::dot(Level &L, std::vector<double> &a,
+                        std::vector<double> &b)
+{
+    double d = 0.0;
+    for (unsigned int i = 1; i <= L.nx; ++i)
+    {
+        const double *x = L.row(a, i);
+        const double *y = L.row(b, i);
+        for (unsigned int j = 1; j <= L.ny; ++j)
+            d += x[j] * y[j];
+    }
+    if (L.distributed)
+    {
+        MPI_Allreduce(MPI_IN_PLACE, &d, 1, MPI_DOUBLE, MPI_SUM, m_comm);
+    }
+    return d;
+}
+
+void LevelSolver::cgStart(Level &L, CGState &cg)
+{
+    residual(L);
+    cg.p = L.r;
+    cg.q.assign(L.u.size(), 0.0);
+    cg.rr = dot(L, L.r, L.r);
+}
+
+void LevelSolver::cgIterate(Level &L, CGState &cg, unsigned int iterations,
+                            double tolerance)
+{
+    for (unsigned int k = 0; k < iterations && cg.rr > tolerance; ++k)
+    {
+        halo(L, cg.p, true);
+        apply(L, cg.p, cg.q);
+        const double pq = dot(L, cg.p, cg.q);
+        if (pq <= 0.0)
+        {
+            break; // converged to round-off
+        }
+        const double alpha = cg.rr / pq;
+        for (unsigned int i = 1; i <= L.nx; ++i)
+        {
+            double *u = L.row(L.u, i);
+            double *r = L.row(L.r, i);
+            const double *p = L.row(cg.p, i);
+            const double *q = L.row(cg.q, i);
+            for (unsigned int j = 1; j <= L.ny; ++j)
+            {
+                u[j] += alpha * p[j];
+                r[j] -= alpha * q[j];
+            }
+        }
+        const double rr = dot(L, L.r, L.r);
+        const double beta = rr / cg.rr;
+        cg.rr = rr;
+        for (unsigned int i = 1; i <= L.nx; ++i)
+        {
+            double *p = L.row(cg.p, i);
+            const double *r = L.row(L.r, i);
+            for (unsigned int j = 1; j <= L.ny; ++j)
+                p[j] = r[j] + beta * p[j];
+        }
+    }
+}
+
+template <class Real>
+void LevelSolver::load(Level &L, const HeatTransfer<Real> &ht)
+{
+    for (unsigned int i = 0; i <= L.nx + 1; ++i)
+        for (unsigned int j = 0; j <= L.ny + 1; ++j)
+            L.row(L.u, i)[j] = ht.T(i, j);
+}
+
+template <class Real>
+void LevelSolver::store(Level &L, HeatTransfer<Real> &ht)
+{
+    // T(i,0) is at data() + (i - 1 + g) * stride + g - 1
+    const size_t g = ht.ghosts();
+    for (unsigned int i = 1; i <= L.nx; ++i)
+    {
+        Real *t = ht.data() + (i - 1 + g) * ht.stride() + g - 1;
+        std::copy_n(L.row(L.u, i) + 1, L.ny, t + 1);
+    }
+}
+
+/* Conjugate gradients on the whole global grid, continued over calls */
+class CGSolver : public LevelSolver
+{
+public:
+    CGSolver(const Settings &s, MPI_Comm comm)
+    : LevelSolver(s, comm), m_level(s.ndx, s.ndy, true, 1.0, true)
+    {
+    }
+
+    void iterate(HeatTransfer<double> &ht,
+                 unsigned int iterations) override
+    {
+        run(ht, iterations);
+    }
+    void iterate(HeatTransfer<float> &ht, unsigned int iterations) override
+    {
+        run(ht, iterations);
+    }
+
+    std::string description() const override
+    {
+        return "conjugate gradient";
+    }
+
+private:
+    Level m_level;
+    CGState m_cg;
+    bool m_started = false;
+
+    template <class Real>
+    void run(HeatTransfer<Real> &ht, unsigned int iterations)
+    {
+        if (!m_started)
+        {
+            load(m_level, ht);
+            cgStart(m_level, m_cg);
+            m_started = true;
+        }
+        cgIterate(m_level, m_cg, iterations, 0.0);
+        store(m_level, ht);
+    }
+};
+
+/* Geometric multigrid V-cycles. The blocks of the processes are coarsened
+ * by 2 in both dimensions while their sizes are even. The residual of the
+ * coarsest distributed level is then gathered on every process, which
+ * coarsen the whole grid further the same way, and the coarsest grid is
+ * solved with conjugate gradients.
+ */
+class MultigridSolver : public LevelSolver
+{
+public:
+    MultigridSolver(const Settings &s, MPI_Comm comm) : LevelSolver(s, comm)
+    {
+        unsigned int nx = s.ndx;
+        unsigned int ny = s.ndy;
+        double edge = 1.0;
+        m_levels.emplace_back(nx, ny, true, edge, true);
+        while (nx % 2 == 0 && ny % 2 == 0 && nx >= 4 && ny >= 4)
+        {
+            nx /= 2;
+            ny /= 2;
+            edge = (edge + 0.5) / 2;
+            m_levels.emplace_back(nx, ny, true, edge, false);
+        }
+        m_agglomerate = m_levels.size() - 1;
+
+        nx *= s.npx;
+        ny *= s.npy;
+        m_levels.emplace_back(nx, ny, false, edge, false);
+        while (nx % 2 == 0 && ny % 2 == 0 && nx >= 4 && ny >= 4)
+        {
+            nx /= 2;
+            ny /= 2;
+            edge = (edge + 0.5) / 2;
+            m_levels.emplace_back(nx, ny, false, edge, false);
+        }
+
+        // position of the block of every process in the global grid
+        int nproc;
+        MPI_Comm_size(comm, &nproc);
+        const int pos[2] = {(int)s.posx, (int)s.posy};
+        m_positions.resize(2 * nproc);
+        MPI_Allgather(pos, 2, MPI_INT, m_positions.data(), 2, MPI_INT, comm);
+    }
+
+    void iterate(HeatTransfer<double> &ht,
+                 unsigned int iterations) override
+    {
+        run(ht, iterations);
+    }
+    void iterate(HeatTransfer<float> &ht, unsigned int iterations) override
+    {
+        run(ht, iterations);
+    }
+
+    std::string description() const override
+    {
+        const Level &fine = m_levels[m_agglomerate];
+        const Level &global = m_levels[m_agglomerate + 1];
+        const Level &coarse = m_levels.back();
+        std::ostringstream d;
+        d << "multigrid V(" << m_s.smoothing << "," << m_s.smoothing
+          << "), " << m_agglomerate + 1 << " distributed level(s) down to "
+          << fine.nx << " x " << fine.ny << ", "
+          << m_levels.size() - m_agglomerate - 1
+          << " level(s) of the whole grid from " << global.nx << " x "
+          << global.ny << " to " << coarse.nx << " x " << coarse.ny;
+        return d.str();
+    }
+
+private:
+    std::vector<Level> m_levels;
+    size_t m_agglomerate;         // last distributed level
+    std::vector<int> m_positions; // posx, posy of every process
+    std::vector<double> m_gather;
+
+    template <class Real>
+    void run(HeatTransfer<Real> &ht, unsigned int iterations)
+    {
+        load(m_levels[0], ht);
+        for (unsigned int k = 0; k < iterations; ++k)
+        {
+            cycle(0);
+        }
+        store(m_levels[0], ht);
+    }
+    void cycle(size_t l);
+    void smooth(Level &L);
+    void restrict(Level &fine, Level &coarse);
+    void prolong(Level &coarse, Level &fine);
+    void gather(Level &block, Level &global);
+    void scatter(Level &global, Level &block);
+};
+
+void MultigridSolver::cycle(size_t l)
+{
+    Level &L = m_levels[l];
+    if (l + 1 == m_levels.size())
+    {
+        // the coarsest grid is small, solve it
+        std::fill(L.u.begin(), L.u.end(), 0.0);
+        CGState cg;
+        cgStart(L, cg);
+        cgIterate(L, cg, 4 * (L.nx + L.ny) + 50, cg.rr * 1e-12);
+        return;
+    }
+
+    smooth(L);
+    residual(L);
+    Level &C = m_levels[l + 1];
+    if (l == m_agglomerate)
+        gather(L, C);
+    else
+        restrict(L, C);
+    std::fill(C.u.begin(), C.u.end(), 0.0);
+    cycle(l + 1);
+    if (l == m_agglomerate)
+        scatter(C, L);
+    else
+        prolong(C, L);
+    smooth(L);
+}
+
+void MultigridSolver::smooth(Level &L)
+{
+    // weighted Jacobi, the relaxation of HeatTransfer
+    const double w4 = 0.8 / 4;
+    for (unsigned int s = 0; s < m_s.smoothing; ++s)
+    {
+        residual(L);
+        for (unsigned int i = 1; i <= L.nx; ++i)
+        {
+            double *u = L.row(L.u, i);
+            const double *r = L.row(L.r, i);
+            for (unsigned int j = 1; j <= L.ny; ++j)
+                u[j] += w4 * r[j];
+        }
+    }
+}
+
+void MultigridSolver::restrict(Level &fine, Level &coarse)
+{
+    // A has no 1/h^2, so the coarse right-hand side is the sum of the four
+    // fine residuals (4 times their mean)
+    for (unsigned int i = 1; i <= coarse.nx; ++i)
+    {
+        const double *r0 = fine.row(fine.r, 2 * i - 1);
+        const double *r1 = fine.row(fine.r, 2 * i);
+        double *f = coarse.row(coarse.f, i);
+        for (unsigned int j = 1; j <= coarse.ny; ++j)
+            f[j] = r0[2 * j - 1] + r0[2 * j] + r1[2 * j - 1] + r1[2 * j];
+    }
+}
+
+void MultigridSolver::prolong(Level &coarse, Level &fine)
+{
+    // bilinear interpolation between the cell centers
+    halo(coarse, coarse.u, true);
+    for (unsigned int i = 1; i <= coarse.nx; ++i)
+    {
+        for (int di = 0; di < 2; ++di)
+        {
+            const double *c = coarse.row(coarse.u, i);
+            const double *n = coarse.row(coarse.u, di ? i + 1 : i - 1);
+            double *u = fine.row(fine.u, 2 * i - 1 + di);
+            for (unsigned int j = 1; j <= coarse.ny; ++j)
+            {
+                const unsigned int jl = j - 1, jr = j + 1;
+                u[2 * j - 1] += 0.5625 * c[j] + 0.1875 * (n[j] + c[jl]) +
+                                0.0625 * n[jl];
+                u[2 * j] += 0.5625 * c[j] + 0.1875 * (n[j] + c[jr]) +
+                            0.0625 * n[jr];
+            }
+        }
+    }
+}
+
+void MultigridSolver::gather(Level &block, Level &global)
+{
+    const size_t n = (size_t)block.nx * block.ny;
+    std::vector<double> local(n);
+    for (unsigned int i = 1; i <= block.nx; ++i)
+        std::copy_n(block.row(block.r, i) + 1, block.ny,
+                    &local[(i - 1) * block.ny]);
+    m_gather.resize(n * m_positions.size() / 2);
+    MPI_Allgather(local.data(), n, MPI_DOUBLE, m_gather.data(), n,
+                  MPI_DOUBLE, m_comm);
+    for (size_t p = 0; p < m_positions.size() / 2; ++p)
+    {
+        const unsigned int i0 = m_positions[2 * p] * block.nx;
+        const unsigned int j0 = m_positions[2 * p + 1] * block.ny;
+        for (unsigned int i = 0; i < block.nx; ++i)
+            std::copy_n(&m_gather[p * n + i * block.ny], block.ny,
+                        global.row(global.f, i0 + i + 1) + j0 + 1);
+    }
+}
+
+void MultigridSolver::scatter(Level &global, Level &block)
+{
+    const unsigned int i0 = m_s.posx * block.nx;
+    const unsigned int j0 = m_s.posy * block.ny;
+    for (unsigned int i = 1; i <= block.nx; ++i)
+    {
+        double *u = block.row(block.u, i);
+        const double *g = global.row(global.u, i0 + i) + j0;
+        for (unsigned int j = 1; j <= block.ny; ++j)
+            u[j] += g[j];
+    }
+}
+
+} // end namespace
+
+std::unique_ptr<Solver> CreateSolver(const Settings &s, MPI_Comm comm)
+{
+    switch (s.solver)
+    {
+    case SolverType::CG:
+        return std::unique_ptr<Solver>(new CGSolver(s, comm));
+    case SolverType::Multigrid:
+        return std::unique_ptr<Solver>(new MultigridSolver(s, comm));
+    default:
+        return nullptr;
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Solver.h
+ *
+ * Solvers for the steady state of the heat equation on the local arrays of
+ * HeatTransfer, as alternatives to its Jacobi relaxation. They compute in
+ * double, also on float storage.
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef SOLVER_H_
+#define SOLVER_H_
+
+#include <mpi.h>
+
+#include <memory>
+#include <string>
+
+#include "HeatTransfer.h"
+#include "Settings.h"
+
+class Solver
+{
+public:
+    virtual ~Solver() = default;
+    // Do the given number of solver iterations on the current T of ht,
+    // which needs valid ghost cells. Only the local block is updated, call
+    // heatEdges() and exchange() on ht afterwards.
+    virtual void iterate(HeatTransfer<double> &ht,
+                         unsigned int iterations) = 0;
+    virtual void iterate(HeatTransfer<float> &ht,
+                         unsigned int iterations) = 0;
+    // name and structure of the solver for the log
+    virtual std::string description() const = 0;
+};
+
+// The solver of Settings::solver, nullptr for the Jacobi relaxation of
+// HeatTransfer. comm is the communicator of the process grid.
+std::unique_ptr<Solver> CreateSolver(const Settings &s, MPI_Comm comm);
+
+#endif /* SOLVER_H_ */
@@ -0,0 +1,74 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * StagingPool.cpp
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "StagingPool.h"
+
+#include <cstring>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// size of the huge pages we ask for
+static const size_t HugePageSize = 2 * 1024 * 1024;
+
+StagingPool::StagingPool(size_t nbuffers, size_t bytes, bool hugepages)
+{
+    // every buffer starts on a page (a huge page if we use them)
+    const size_t page = (hugepages ? HugePageSize : sysconf(_SC_PAGESIZE));
+    const size_t stride = (bytes + page - 1) / page * page;
+    m_bytes = nbuffers * stride;
+
+    m_memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugepages)
+    {
+        m_memory = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        m_hugetlb = (m_memory != MAP_FAILED);
+    }
+#endif
+    if (m_memory == MAP_FAILED)
+    {
+        // no reserved huge pages: normal pages, transparent huge pages if
+        // the kernel can provide them
+        m_memory = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_memory == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        if (hugepages)
+        {
+            madvise(m_memory, m_bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    char *p = static_cast<char *>(m_memory);
+    for (size_t b = 0; b < nbuffers; ++b)
+    {
+        m_buffers.push_back(p + b * stride);
+    }
+
+    // touch every page now, each buffer split over the threads like the
+    // copy of the array rows into it
+    const long npages = stride / page;
+    for (char *q : m_buffers)
+    {
+#pragma omp parallel for schedule(static)
+        for (long i = 0; i < npages; ++i)
+        {
+            std::memset(q + i * page, 0, page);
+        }
+    }
+}
+
+StagingPool::~StagingPool() { munmap(m_memory, m_bytes); }
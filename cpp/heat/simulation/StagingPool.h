@@ -0,0 +1,47 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * StagingPool.h
+ *
+ * Fixed set of page-aligned buffers for output snapshots, allocated once
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef STAGINGPOOL_H_
+#define STAGINGPOOL_H_
+
+#include <cstddef>
+#include <vector>
+
+class StagingPool
+{
+public:
+    // nbuffers buffers of the given size each, in huge pages if hugepages is
+    // true and the system has them. All pages are touched here so that
+    // no page faults happen when the buffers are filled later.
+    StagingPool(size_t nbuffers, size_t bytes, bool hugepages);
+    ~StagingPool();
+    StagingPool(const StagingPool &) = delete;
+    StagingPool &operator=(const StagingPool &) = delete;
+
+    size_t size() const { return m_buffers.size(); };
+    // buffer b as an array of T
+    template <class T>
+    T *buffer(size_t b) const
+    {
+        return reinterpret_cast<T *>(m_buffers[b]);
+    };
+    // true if the buffers are in explicitly reserved huge pages
+    // (MAP_HUGETLB), false for normal or transparent huge pages
+    bool hugePages() const { return m_hugetlb; };
+
+private:
+    void *m_memory;
+    size_t m_bytes;
+    bool m_hugetlb = false;
+    std::vector<char *> m_buffers;
+};
+
+#endif /* STAGINGPOOL_H_ */
@@ -0,0 +1,1149 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Stencil.cpp
+ *
+ * The x86 kernels are compiled with function target attributes and picked
+ * at runtime, so no special compiler flags are needed. They sum the four
+ * (six in 3D) neighbors in the same order as the scalar code but use FMA for
+ * the final weighting, so they match the scalar kernel within round-off.
+ *
+ *  Created on: Oct 2026
+ */
+
+#include "Stencil.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+#include <unistd.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define HEAT_STENCIL_X86
+#include <immintrin.h>
+#endif
+
+template <class Real>
+static void StencilRowScalar(Real *next, const Real *up, const Real *mid,
+                             const Real *down, size_t n, Real omega)
+{
+    const Real w4 = omega / 4;
+    const Real w1 = 1 - omega;
+    const ptrdiff_t len = n;
+    for (ptrdiff_t j = 0; j < len; ++j)
+    {
+        next[j] =
+            w4 * (up[j] + down[j] + mid[j - 1] + mid[j + 1]) + w1 * mid[j];
+    }
+}
+
+template <class Real>
+static void StencilRowStatsScalar(Real *next, const Real *up, const Real *mid,
+                                  const Real *down, size_t n, Real omega,
+                                  StencilStats &stats)
+{
+    const Real w4 = omega / 4;
+    const Real w1 = 1 - omega;
+    const ptrdiff_t len = n;
+    double vmin = stats.min, vmax = stats.max, sum = 0.0;
+    double change2 = 0.0, changeMax = stats.changeMax;
+    for (ptrdiff_t j = 0; j < len; ++j)
+    {
+        const Real v =
+            w4 * (up[j] + down[j] + mid[j - 1] + mid[j + 1]) + w1 * mid[j];
+        const double d = v - mid[j];
+        next[j] = v;
+        vmin = std::min<double>(vmin, v);
+        vmax = std::max<double>(vmax, v);
+        sum += v;
+        change2 += d * d;
+        changeMax = std::max(changeMax, std::fabs(d));
+    }
+    stats.min = vmin;
+    stats.max = vmax;
+    stats.sum += sum;
+    stats.change2 += change2;
+    stats.changeMax = changeMax;
+    stats.cells += n;
+}
+
+template <class Real>
+static void StencilRow3DScalar(Real *next, const Real *up, const Real *mid,
+                               const Real *down, const Real *front,
+                               const Real *back, size_t n, Real omega)
+{
+    const Real w6 = omega / 6;
+    const Real w1 = 1 - omega;
+    const ptrdiff_t len = n;
+    for (ptrdiff_t j = 0; j < len; ++j)
+    {
+        next[j] = w6 * (up[j] + down[j] + mid[j - 1] + mid[j + 1] +
+                        front[j] + back[j]) +
+                  w1 * mid[j];
+    }
+}
+
+template <class Real>
+static void StencilRow3DStatsScalar(Real *next, const Real *up,
+                                    const Real *mid, const Real *down,
+                                    const Real *front, const Real *back,
+                                    size_t n, Real omega, StencilStats &stats)
+{
+    const Real w6 = omega / 6;
+    const Real w1 = 1 - omega;
+    const ptrdiff_t len = n;
+    double vmin = stats.min, vmax = stats.max, sum = 0.0;
+    double change2 = 0.0, changeMax = stats.changeMax;
+    for (ptrdiff_t j = 0; j < len; ++j)
+    {
+        const Real v = w6 * (up[j] + down[j] + mid[j - 1] + mid[j + 1] +
+                             front[j] + back[j]) +
+                       w1 * mid[j];
+        const double d = v - mid[j];
+        next[j] = v;
+        vmin = std::min<double>(vmin, v);
+        vmax = std::max<double>(vmax, v);
+        sum += v;
+        change2 += d * d;
+        changeMax = std::max(changeMax, std::fabs(d));
+    }
+    stats.min = vmin;
+    stats.max = vmax;
+    stats.sum += sum;
+    stats.change2 += change2;
+    stats.changeMax = changeMax;
+    stats.cells += n;
+}
+
+#ifdef HEAT_STENCIL_X86
+
+__attribute__((target("avx2"))) static double hmin256(__m256d v)
+{
+    const __m128d m = _mm_min_pd(_mm256_castpd256_pd128(v),
+                                 _mm256_extractf128_pd(v, 1));
+    return std::min(_mm_cvtsd_f64(m), _mm_cvtsd_f64(_mm_unpackhi_pd(m, m)));
+}
+
+__attribute__((target("avx2"))) static double hmax256(__m256d v)
+{
+    const __m128d m = _mm_max_pd(_mm256_castpd256_pd128(v),
+                                 _mm256_extractf128_pd(v, 1));
+    return std::max(_mm_cvtsd_f64(m), _mm_cvtsd_f64(_mm_unpackhi_pd(m, m)));
+}
+
+__attribute__((target("avx2"))) static double hsum256(__m256d v)
+{
+    const __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v),
+                                 _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+__attribute__((target("avx2,fma"))) static void
+StencilRowAVX2(double *next, const double *up, const double *mid,
+               const double *down, size_t n, double omega)
+{
+    const __m256d w4 = _mm256_set1_pd(omega / 4);
+    const __m256d w1 = _mm256_set1_pd(1.0 - omega);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m256d s =
+            _mm256_add_pd(_mm256_loadu_pd(up + j), _mm256_loadu_pd(down + j));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j - 1));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j + 1));
+        const __m256d c = _mm256_loadu_pd(mid + j);
+        _mm256_storeu_pd(next + j,
+                         _mm256_fmadd_pd(w4, s, _mm256_mul_pd(w1, c)));
+    }
+    StencilRowScalar(next + j, up + j, mid + j, down + j, n - j, omega);
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRowAVX512(double *next, const double *up, const double *mid,
+                 const double *down, size_t n, double omega)
+{
+    const __m512d w4 = _mm512_set1_pd(omega / 4);
+    const __m512d w1 = _mm512_set1_pd(1.0 - omega);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m512d s =
+            _mm512_add_pd(_mm512_loadu_pd(up + j), _mm512_loadu_pd(down + j));
+        s = _mm512_add_pd(s, _mm512_loadu_pd(mid + j - 1));
+        s = _mm512_add_pd(s, _mm512_loadu_pd(mid + j + 1));
+        const __m512d c = _mm512_loadu_pd(mid + j);
+        _mm512_storeu_pd(next + j,
+                         _mm512_fmadd_pd(w4, s, _mm512_mul_pd(w1, c)));
+    }
+    if (j < n)
+    {
+        // remainder with masked loads/stores instead of a scalar loop
+        const __mmask8 m = (__mmask8)((1u << (n - j)) - 1);
+        __m512d s = _mm512_add_pd(_mm512_maskz_loadu_pd(m, up + j),
+                                  _mm512_maskz_loadu_pd(m, down + j));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j - 1));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j + 1));
+        const __m512d c = _mm512_maskz_loadu_pd(m, mid + j);
+        _mm512_mask_storeu_pd(next + j, m,
+                              _mm512_fmadd_pd(w4, s, _mm512_mul_pd(w1, c)));
+    }
+}
+
+__attribute__((target("avx2,fma"))) static void
+StencilRowStatsAVX2(double *next, const double *up, const double *mid,
+                    const double *down, size_t n, double omega,
+                    StencilStats &stats)
+{
+    const __m256d w4 = _mm256_set1_pd(omega / 4);
+    const __m256d w1 = _mm256_set1_pd(1.0 - omega);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d vmin = _mm256_set1_pd(stats.min);
+    __m256d vmax = _mm256_set1_pd(stats.max);
+    __m256d vsum = _mm256_setzero_pd();
+    __m256d vchange2 = _mm256_setzero_pd();
+    __m256d vchangeMax = _mm256_set1_pd(stats.changeMax);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m256d s =
+            _mm256_add_pd(_mm256_loadu_pd(up + j), _mm256_loadu_pd(down + j));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j - 1));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j + 1));
+        const __m256d c = _mm256_loadu_pd(mid + j);
+        const __m256d v = _mm256_fmadd_pd(w4, s, _mm256_mul_pd(w1, c));
+        _mm256_storeu_pd(next + j, v);
+        const __m256d d = _mm256_sub_pd(v, c);
+        vmin = _mm256_min_pd(vmin, v);
+        vmax = _mm256_max_pd(vmax, v);
+        vsum = _mm256_add_pd(vsum, v);
+        vchange2 = _mm256_fmadd_pd(d, d, vchange2);
+        vchangeMax = _mm256_max_pd(vchangeMax, _mm256_andnot_pd(sign, d));
+    }
+    stats.min = hmin256(vmin);
+    stats.max = hmax256(vmax);
+    stats.sum += hsum256(vsum);
+    stats.change2 += hsum256(vchange2);
+    stats.changeMax = hmax256(vchangeMax);
+    stats.cells += j;
+    StencilRowStatsScalar(next + j, up + j, mid + j, down + j, n - j, omega,
+                          stats);
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRowStatsAVX512(double *next, const double *up, const double *mid,
+                      const double *down, size_t n, double omega,
+                      StencilStats &stats)
+{
+    const __m512d w4 = _mm512_set1_pd(omega / 4);
+    const __m512d w1 = _mm512_set1_pd(1.0 - omega);
+    __m512d vmin = _mm512_set1_pd(stats.min);
+    __m512d vmax = _mm512_set1_pd(stats.max);
+    __m512d vsum = _mm512_setzero_pd();
+    __m512d vchange2 = _mm512_setzero_pd();
+    __m512d vchangeMax = _mm512_set1_pd(stats.changeMax);
+    for (size_t j = 0; j < n; j += 8)
+    {
+        // the remainder with masked loads/stores, the masked-off lanes
+        // keep the statistics unchanged
+        const __mmask8 m =
+            (n - j >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - j)) - 1));
+        __m512d s = _mm512_add_pd(_mm512_maskz_loadu_pd(m, up + j),
+                                  _mm512_maskz_loadu_pd(m, down + j));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j - 1));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j + 1));
+        const __m512d c = _mm512_maskz_loadu_pd(m, mid + j);
+        const __m512d v = _mm512_fmadd_pd(w4, s, _mm512_mul_pd(w1, c));
+        _mm512_mask_storeu_pd(next + j, m, v);
+        const __m512d d = _mm512_sub_pd(v, c);
+        vmin = _mm512_mask_min_pd(vmin, m, vmin, v);
+        vmax = _mm512_mask_max_pd(vmax, m, vmax, v);
+        vsum = _mm512_mask_add_pd(vsum, m, vsum, v);
+        vchange2 = _mm512_mask3_fmadd_pd(d, d, vchange2, m);
+        vchangeMax = _mm512_mask_max_pd(vchangeMax, m, vchangeMax,
+                                        _mm512_abs_pd(d));
+    }
+    alignas(64) double lanes[5][8];
+    _mm512_store_pd(lanes[0], vmin);
+    _mm512_store_pd(lanes[1], vmax);
+    _mm512_store_pd(lanes[2], vsum);
+    _mm512_store_pd(lanes[3], vchange2);
+    _mm512_store_pd(lanes[4], vchangeMax);
+    for (int l = 0; l < 8; ++l)
+    {
+        stats.min = std::min(stats.min, lanes[0][l]);
+        stats.max = std::max(stats.max, lanes[1][l]);
+        stats.sum += lanes[2][l];
+        stats.change2 += lanes[3][l];
+        stats.changeMax = std::max(stats.changeMax, lanes[4][l]);
+    }
+    stats.cells += n;
+}
+
+/* The float kernels compute in float, twice the cells per vector, and
+ * widen the new values and their changes to double for the sums
+ */
+
+__attribute__((target("avx2,fma"))) static void
+StencilRowAVX2(float *next, const float *up, const float *mid,
+               const float *down, size_t n, float omega)
+{
+    const __m256 w4 = _mm256_set1_ps(omega / 4);
+    const __m256 w1 = _mm256_set1_ps(1.0f - omega);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256 s =
+            _mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j - 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j + 1));
+        const __m256 c = _mm256_loadu_ps(mid + j);
+        _mm256_storeu_ps(next + j,
+                         _mm256_fmadd_ps(w4, s, _mm256_mul_ps(w1, c)));
+    }
+    StencilRowScalar(next + j, up + j, mid + j, down + j, n - j, omega);
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRowAVX512(float *next, const float *up, const float *mid,
+                 const float *down, size_t n, float omega)
+{
+    const __m512 w4 = _mm512_set1_ps(omega / 4);
+    const __m512 w1 = _mm512_set1_ps(1.0f - omega);
+    for (size_t j = 0; j < n; j += 16)
+    {
+        const __mmask16 m =
+            (n - j >= 16 ? (__mmask16)0xffff
+                         : (__mmask16)((1u << (n - j)) - 1));
+        __m512 s = _mm512_add_ps(_mm512_maskz_loadu_ps(m, up + j),
+                                 _mm512_maskz_loadu_ps(m, down + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j - 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j + 1));
+        const __m512 c = _mm512_maskz_loadu_ps(m, mid + j);
+        _mm512_mask_storeu_ps(next + j, m,
+                              _mm512_fmadd_ps(w4, s, _mm512_mul_ps(w1, c)));
+    }
+}
+
+__attribute__((target("avx2,fma"))) static void
+StencilRowStatsAVX2(float *next, const float *up, const float *mid,
+                    const float *down, size_t n, float omega,
+                    StencilStats &stats)
+{
+    const __m256 w4 = _mm256_set1_ps(omega / 4);
+    const __m256 w1 = _mm256_set1_ps(1.0f - omega);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 vmin = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    __m256 vmax = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 vchangeMax = _mm256_setzero_ps();
+    __m256d vsum = _mm256_setzero_pd();
+    __m256d vchange2 = _mm256_setzero_pd();
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256 s =
+            _mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j - 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j + 1));
+        const __m256 c = _mm256_loadu_ps(mid + j);
+        const __m256 v = _mm256_fmadd_ps(w4, s, _mm256_mul_ps(w1, c));
+        _mm256_storeu_ps(next + j, v);
+        const __m256 d = _mm256_sub_ps(v, c);
+        vmin = _mm256_min_ps(vmin, v);
+        vmax = _mm256_max_ps(vmax, v);
+        vchangeMax = _mm256_max_ps(vchangeMax, _mm256_andnot_ps(sign, d));
+        const __m256d vlo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+        const __m256d vhi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+        const __m256d dlo = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+        const __m256d dhi = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+        vsum = _mm256_add_pd(vsum, _mm256_add_pd(vlo, vhi));
+        vchange2 = _mm256_fmadd_pd(dlo, dlo, vchange2);
+        vchange2 = _mm256_fmadd_pd(dhi, dhi, vchange2);
+    }
+    alignas(32) float lanes[3][8];
+    _mm256_store_ps(lanes[0], vmin);
+    _mm256_store_ps(lanes[1], vmax);
+    _mm256_store_ps(lanes[2], vchangeMax);
+    for (int l = 0; l < 8; ++l)
+    {
+        stats.min = std::min<double>(stats.min, lanes[0][l]);
+        stats.max = std::max<double>(stats.max, lanes[1][l]);
+        stats.changeMax = std::max<double>(stats.changeMax, lanes[2][l]);
+    }
+    stats.sum += hsum256(vsum);
+    stats.change2 += hsum256(vchange2);
+    stats.cells += j;
+    StencilRowStatsScalar(next + j, up + j, mid + j, down + j, n - j, omega,
+                          stats);
+}
+
+// the low (half 0) or high (half 1) 8 elements of v as doubles; the
+// masked forms do not start from an undefined vector, which GCC warns about
+__attribute__((target("avx512f"))) static inline __m512d widen512(__m512 v,
+                                                                 int half)
+{
+    const __m512d x = _mm512_castps_pd(v);
+    const __m256d h =
+        (half ? _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xf, x, 1)
+              : _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xf, x, 0));
+    return _mm512_maskz_cvtps_pd(0xff, _mm256_castpd_ps(h));
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRowStatsAVX512(float *next, const float *up, const float *mid,
+                      const float *down, size_t n, float omega,
+                      StencilStats &stats)
+{
+    const __m512 w4 = _mm512_set1_ps(omega / 4);
+    const __m512 w1 = _mm512_set1_ps(1.0f - omega);
+    __m512 vmin = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+    __m512 vmax = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    __m512 vchangeMax = _mm512_setzero_ps();
+    __m512d vsum = _mm512_setzero_pd();
+    __m512d vchange2 = _mm512_setzero_pd();
+    for (size_t j = 0; j < n; j += 16)
+    {
+        // the masked-off lanes load 0, so v and d are 0 there and only
+        // the minimum and maximum need the mask
+        const __mmask16 m =
+            (n - j >= 16 ? (__mmask16)0xffff
+                         : (__mmask16)((1u << (n - j)) - 1));
+        __m512 s = _mm512_add_ps(_mm512_maskz_loadu_ps(m, up + j),
+                                 _mm512_maskz_loadu_ps(m, down + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j - 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j + 1));
+        const __m512 c = _mm512_maskz_loadu_ps(m, mid + j);
+        const __m512 v = _mm512_fmadd_ps(w4, s, _mm512_mul_ps(w1, c));
+        _mm512_mask_storeu_ps(next + j, m, v);
+        const __m512 d = _mm512_sub_ps(v, c);
+        vmin = _mm512_mask_min_ps(vmin, m, vmin, v);
+        vmax = _mm512_mask_max_ps(vmax, m, vmax, v);
+        vchangeMax = _mm512_mask_max_ps(vchangeMax, m, vchangeMax,
+                                        _mm512_abs_ps(d));
+        const __m512d vlo = widen512(v, 0);
+        const __m512d vhi = widen512(v, 1);
+        const __m512d dlo = widen512(d, 0);
+        const __m512d dhi = widen512(d, 1);
+        vsum = _mm512_add_pd(vsum, _mm512_add_pd(vlo, vhi));
+        vchange2 = _mm512_fmadd_pd(dlo, dlo, vchange2);
+        vchange2 = _mm512_fmadd_pd(dhi, dhi, vchange2);
+    }
+    alignas(64) float lanes[3][16];
+    alignas(64) double sums[2][8];
+    _mm512_store_ps(lanes[0], vmin);
+    _mm512_store_ps(lanes[1], vmax);
+    _mm512_store_ps(lanes[2], vchangeMax);
+    _mm512_store_pd(sums[0], vsum);
+    _mm512_store_pd(sums[1], vchange2);
+    for (int l = 0; l < 16; ++l)
+    {
+        stats.min = std::min<double>(stats.min, lanes[0][l]);
+        stats.max = std::max<double>(stats.max, lanes[1][l]);
+        stats.changeMax = std::max<double>(stats.changeMax, lanes[2][l]);
+    }
+    for (int l = 0; l < 8; ++l)
+    {
+        stats.sum += sums[0][l];
+        stats.change2 += sums[1][l];
+    }
+    stats.cells += n;
+}
+
+/* The 7-point kernels of 3D arrays, the same as the 5-point kernels with
+ * the front and back neighbors added last
+ */
+
+__attribute__((target("avx2,fma"))) static void
+StencilRow3DAVX2(double *next, const double *up, const double *mid,
+                 const double *down, const double *front, const double *back,
+                 size_t n, double omega)
+{
+    const __m256d w6 = _mm256_set1_pd(omega / 6);
+    const __m256d w1 = _mm256_set1_pd(1.0 - omega);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m256d s =
+            _mm256_add_pd(_mm256_loadu_pd(up + j), _mm256_loadu_pd(down + j));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j - 1));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j + 1));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(front + j));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(back + j));
+        const __m256d c = _mm256_loadu_pd(mid + j);
+        _mm256_storeu_pd(next + j,
+                         _mm256_fmadd_pd(w6, s, _mm256_mul_pd(w1, c)));
+    }
+    StencilRow3DScalar(next + j, up + j, mid + j, down + j, front + j,
+                       back + j, n - j, omega);
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRow3DAVX512(double *next, const double *up, const double *mid,
+                   const double *down, const double *front,
+                   const double *back, size_t n, double omega)
+{
+    const __m512d w6 = _mm512_set1_pd(omega / 6);
+    const __m512d w1 = _mm512_set1_pd(1.0 - omega);
+    for (size_t j = 0; j < n; j += 8)
+    {
+        const __mmask8 m =
+            (n - j >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - j)) - 1));
+        __m512d s = _mm512_add_pd(_mm512_maskz_loadu_pd(m, up + j),
+                                  _mm512_maskz_loadu_pd(m, down + j));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j - 1));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j + 1));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, front + j));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, back + j));
+        const __m512d c = _mm512_maskz_loadu_pd(m, mid + j);
+        _mm512_mask_storeu_pd(next + j, m,
+                              _mm512_fmadd_pd(w6, s, _mm512_mul_pd(w1, c)));
+    }
+}
+
+__attribute__((target("avx2,fma"))) static void
+StencilRow3DStatsAVX2(double *next, const double *up, const double *mid,
+                      const double *down, const double *front,
+                      const double *back, size_t n, double omega,
+                      StencilStats &stats)
+{
+    const __m256d w6 = _mm256_set1_pd(omega / 6);
+    const __m256d w1 = _mm256_set1_pd(1.0 - omega);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d vmin = _mm256_set1_pd(stats.min);
+    __m256d vmax = _mm256_set1_pd(stats.max);
+    __m256d vsum = _mm256_setzero_pd();
+    __m256d vchange2 = _mm256_setzero_pd();
+    __m256d vchangeMax = _mm256_set1_pd(stats.changeMax);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        __m256d s =
+            _mm256_add_pd(_mm256_loadu_pd(up + j), _mm256_loadu_pd(down + j));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j - 1));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(mid + j + 1));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(front + j));
+        s = _mm256_add_pd(s, _mm256_loadu_pd(back + j));
+        const __m256d c = _mm256_loadu_pd(mid + j);
+        const __m256d v = _mm256_fmadd_pd(w6, s, _mm256_mul_pd(w1, c));
+        _mm256_storeu_pd(next + j, v);
+        const __m256d d = _mm256_sub_pd(v, c);
+        vmin = _mm256_min_pd(vmin, v);
+        vmax = _mm256_max_pd(vmax, v);
+        vsum = _mm256_add_pd(vsum, v);
+        vchange2 = _mm256_fmadd_pd(d, d, vchange2);
+        vchangeMax = _mm256_max_pd(vchangeMax, _mm256_andnot_pd(sign, d));
+    }
+    stats.min = hmin256(vmin);
+    stats.max = hmax256(vmax);
+    stats.sum += hsum256(vsum);
+    stats.change2 += hsum256(vchange2);
+    stats.changeMax = hmax256(vchangeMax);
+    stats.cells += j;
+    StencilRow3DStatsScalar(next + j, up + j, mid + j, down + j, front + j,
+                            back + j, n - j, omega, stats);
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRow3DStatsAVX512(double *next, const double *up, const double *mid,
+                        const double *down, const double *front,
+                        const double *back, size_t n, double omega,
+                        StencilStats &stats)
+{
+    const __m512d w6 = _mm512_set1_pd(omega / 6);
+    const __m512d w1 = _mm512_set1_pd(1.0 - omega);
+    __m512d vmin = _mm512_set1_pd(stats.min);
+    __m512d vmax = _mm512_set1_pd(stats.max);
+    __m512d vsum = _mm512_setzero_pd();
+    __m512d vchange2 = _mm512_setzero_pd();
+    __m512d vchangeMax = _mm512_set1_pd(stats.changeMax);
+    for (size_t j = 0; j < n; j += 8)
+    {
+        const __mmask8 m =
+            (n - j >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - j)) - 1));
+        __m512d s = _mm512_add_pd(_mm512_maskz_loadu_pd(m, up + j),
+                                  _mm512_maskz_loadu_pd(m, down + j));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j - 1));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, mid + j + 1));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, front + j));
+        s = _mm512_add_pd(s, _mm512_maskz_loadu_pd(m, back + j));
+        const __m512d c = _mm512_maskz_loadu_pd(m, mid + j);
+        const __m512d v = _mm512_fmadd_pd(w6, s, _mm512_mul_pd(w1, c));
+        _mm512_mask_storeu_pd(next + j, m, v);
+        const __m512d d = _mm512_sub_pd(v, c);
+        vmin = _mm512_mask_min_pd(vmin, m, vmin, v);
+        vmax = _mm512_mask_max_pd(vmax, m, vmax, v);
+        vsum = _mm512_mask_add_pd(vsum, m, vsum, v);
+        vchange2 = _mm512_mask3_fmadd_pd(d, d, vchange2, m);
+        vchangeMax = _mm512_mask_max_pd(vchangeMax, m, vchangeMax,
+                                        _mm512_abs_pd(d));
+    }
+    alignas(64) double lanes[5][8];
+    _mm512_store_pd(lanes[0], vmin);
+    _mm512_store_pd(lanes[1], vmax);
+    _mm512_store_pd(lanes[2], vsum);
+    _mm512_store_pd(lanes[3], vchange2);
+    _mm512_store_pd(lanes[4], vchangeMax);
+    for (int l = 0; l < 8; ++l)
+    {
+        stats.min = std::min(stats.min, lanes[0][l]);
+        stats.max = std::max(stats.max, lanes[1][l]);
+        stats.sum += lanes[2][l];
+        stats.change2 += lanes[3][l];
+        stats.changeMax = std::max(stats.changeMax, lanes[4][l]);
+    }
+    stats.cells += n;
+}
+
+__attribute__((target("avx2,fma"))) static void
+StencilRow3DAVX2(float *next, const float *up, const float *mid,
+                 const float *down, const float *front, const float *back,
+                 size_t n, float omega)
+{
+    const __m256 w6 = _mm256_set1_ps(omega / 6);
+    const __m256 w1 = _mm256_set1_ps(1.0f - omega);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256 s =
+            _mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j - 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j + 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(front + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(back + j));
+        const __m256 c = _mm256_loadu_ps(mid + j);
+        _mm256_storeu_ps(next + j,
+                         _mm256_fmadd_ps(w6, s, _mm256_mul_ps(w1, c)));
+    }
+    StencilRow3DScalar(next + j, up + j, mid + j, down + j, front + j,
+                       back + j, n - j, omega);
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRow3DAVX512(float *next, const float *up, const float *mid,
+                   const float *down, const float *front, const float *back,
+                   size_t n, float omega)
+{
+    const __m512 w6 = _mm512_set1_ps(omega / 6);
+    const __m512 w1 = _mm512_set1_ps(1.0f - omega);
+    for (size_t j = 0; j < n; j += 16)
+    {
+        const __mmask16 m =
+            (n - j >= 16 ? (__mmask16)0xffff
+                         : (__mmask16)((1u << (n - j)) - 1));
+        __m512 s = _mm512_add_ps(_mm512_maskz_loadu_ps(m, up + j),
+                                 _mm512_maskz_loadu_ps(m, down + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j - 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j + 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, front + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, back + j));
+        const __m512 c = _mm512_maskz_loadu_ps(m, mid + j);
+        _mm512_mask_storeu_ps(next + j, m,
+                              _mm512_fmadd_ps(w6, s, _mm512_mul_ps(w1, c)));
+    }
+}
+
+__attribute__((target("avx2,fma"))) static void
+StencilRow3DStatsAVX2(float *next, const float *up, const float *mid,
+                      const float *down, const float *front,
+                      const float *back, size_t n, float omega,
+                      StencilStats &stats)
+{
+    const __m256 w6 = _mm256_set1_ps(omega / 6);
+    const __m256 w1 = _mm256_set1_ps(1.0f - omega);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 vmin = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    __m256 vmax = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 vchangeMax = _mm256_setzero_ps();
+    __m256d vsum = _mm256_setzero_pd();
+    __m256d vchange2 = _mm256_setzero_pd();
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256 s =
+            _mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j - 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(mid + j + 1));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(front + j));
+        s = _mm256_add_ps(s, _mm256_loadu_ps(back + j));
+        const __m256 c = _mm256_loadu_ps(mid + j);
+        const __m256 v = _mm256_fmadd_ps(w6, s, _mm256_mul_ps(w1, c));
+        _mm256_storeu_ps(next + j, v);
+        const __m256 d = _mm256_sub_ps(v, c);
+        vmin = _mm256_min_ps(vmin, v);
+        vmax = _mm256_max_ps(vmax, v);
+        vchangeMax = _mm256_max_ps(vchangeMax, _mm256_andnot_ps(sign, d));
+        const __m256d vlo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+        const __m256d vhi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+        const __m256d dlo = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+        const __m256d dhi = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+        vsum = _mm256_add_pd(vsum, _mm256_add_pd(vlo, vhi));
+        vchange2 = _mm256_fmadd_pd(dlo, dlo, vchange2);
+        vchange2 = _mm256_fmadd_pd(dhi, dhi, vchange2);
+    }
+    alignas(32) float lanes[3][8];
+    _mm256_store_ps(lanes[0], vmin);
+    _mm256_store_ps(lanes[1], vmax);
+    _mm256_store_ps(lanes[2], vchangeMax);
+    for (int l = 0; l < 8; ++l)
+    {
+        stats.min = std::min<double>(stats.min, lanes[0][l]);
+        stats.max = std::max<double>(stats.max, lanes[1][l]);
+        stats.changeMax = std::max<double>(stats.changeMax, lanes[2][l]);
+    }
+    stats.sum += hsum256(vsum);
+    stats.change2 += hsum256(vchange2);
+    stats.cells += j;
+    StencilRow3DStatsScalar(next + j, up + j, mid + j, down + j, front + j,
+                            back + j, n - j, omega, stats);
+}
+
+__attribute__((target("avx512f"))) static void
+StencilRow3DStatsAVX512(float *next, const float *up, const float *mid,
+                        const float *down, const float *front,
+                        const float *back, size_t n, float omega,
+                        StencilStats &stats)
+{
+    const __m512 w6 = _mm512_set1_ps(omega / 6);
+    const __m512 w1 = _mm512_set1_ps(1.0f - omega);
+    __m512 vmin = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+    __m512 vmax = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    __m512 vchangeMax = _mm512_setzero_ps();
+    __m512d vsum = _mm512_setzero_pd();
+    __m512d vchange2 = _mm512_setzero_pd();
+    for (size_t j = 0; j < n; j += 16)
+    {
+        const __mmask16 m =
+            (n - j >= 16 ? (__mmask16)0xffff
+                         : (__mmask16)((1u << (n - j)) - 1));
+        __m512 s = _mm512_add_ps(_mm512_maskz_loadu_ps(m, up + j),
+                                 _mm512_maskz_loadu_ps(m, down + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j - 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, mid + j + 1));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, front + j));
+        s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, back + j));
+        const __m512 c = _mm512_maskz_loadu_ps(m, mid + j);
+        const __m512 v = _mm512_fmadd_ps(w6, s, _mm512_mul_ps(w1, c));
+        _mm512_mask_storeu_ps(next + j, m, v);
+        const __m512 d = _mm512_sub_ps(v, c);
+        vmin = _mm512_mask_min_ps(vmin, m, vmin, v);
+        vmax = _mm512_mask_max_ps(vmax, m, vmax, v);
+        vchangeMax = _mm512_mask_max_ps(vchangeMax, m, vchangeMax,
+                                        _mm512_abs_ps(d));
+        const __m512d vlo = widen512(v, 0);
+        const __m512d vhi = widen512(v, 1);
+        const __m512d dlo = widen512(d, 0);
+        const __m512d dhi = widen512(d, 1);
+        vsum = _mm512_add_pd(vsum, _mm512_add_pd(vlo, vhi));
+        vchange2 = _mm512_fmadd_pd(dlo, dlo, vchange2);
+        vchange2 = _mm512_fmadd_pd(dhi, dhi, vchange2);
+    }
+    alignas(64) float lanes[3][16];
+    alignas(64) double sums[2][8];
+    _mm512_store_ps(lanes[0], vmin);
+    _mm512_store_ps(lanes[1], vmax);
+    _mm512_store_ps(lanes[2], vchangeMax);
+    _mm512_store_pd(sums[0], vsum);
+    _mm512_store_pd(sums[1], vchange2);
+    for (int l = 0; l < 16; ++l)
+    {
+        stats.min = std::min<double>(stats.min, lanes[0][l]);
+        stats.max = std::max<double>(stats.max, lanes[1][l]);
+        stats.changeMax = std::max<double>(stats.changeMax, lanes[2][l]);
+    }
+    for (int l = 0; l < 8; ++l)
+    {
+        stats.sum += sums[0][l];
+        stats.change2 += sums[1][l];
+    }
+    stats.cells += n;
+}
+
+#endif /* HEAT_STENCIL_X86 */
+
+void StencilStats::merge(const StencilStats &o)
+{
+    min = std::min(min, o.min);
+    max = std::max(max, o.max);
+    sum += o.sum;
+    change2 += o.change2;
+    changeMax = std::max(changeMax, o.changeMax);
+    cells += o.cells;
+}
+
+bool StencilSupported(StencilISA isa)
+{
+    switch (isa)
+    {
+    case StencilISA::Scalar:
+        return true;
+#ifdef HEAT_STENCIL_X86
+    case StencilISA::AVX2:
+        return __builtin_cpu_supports("avx2") &&
+               __builtin_cpu_supports("fma");
+    case StencilISA::AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+StencilISA StencilDetectISA()
+{
+    if (StencilSupported(StencilISA::AVX512))
+        return StencilISA::AVX512;
+    if (StencilSupported(StencilISA::AVX2))
+        return StencilISA::AVX2;
+    return StencilISA::Scalar;
+}
+
+const char *StencilISAName(StencilISA isa)
+{
+    switch (isa)
+    {
+    case StencilISA::AVX2:
+        return "AVX2";
+    case StencilISA::AVX512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+template <class Real>
+StencilRowFunc<Real> StencilRowKernel(StencilISA isa)
+{
+    if (!StencilSupported(isa))
+    {
+        return StencilRowScalar<Real>;
+    }
+    switch (isa)
+    {
+#ifdef HEAT_STENCIL_X86
+    case StencilISA::AVX2:
+        return StencilRowAVX2;
+    case StencilISA::AVX512:
+        return StencilRowAVX512;
+#endif
+    default:
+        return StencilRowScalar<Real>;
+    }
+}
+
+template <class Real>
+StencilRowStatsFunc<Real> StencilRowStatsKernel(StencilISA isa)
+{
+    if (!StencilSupported(isa))
+    {
+        return StencilRowStatsScalar<Real>;
+    }
+    switch (isa)
+    {
+#ifdef HEAT_STENCIL_X86
+    case StencilISA::AVX2:
+        return StencilRowStatsAVX2;
+    case StencilISA::AVX512:
+        return StencilRowStatsAVX512;
+#endif
+    default:
+        return StencilRowStatsScalar<Real>;
+    }
+}
+
+template <class Real>
+StencilRow3DFunc<Real> StencilRow3DKernel(StencilISA isa)
+{
+    if (!StencilSupported(isa))
+    {
+        return StencilRow3DScalar<Real>;
+    }
+    switch (isa)
+    {
+#ifdef HEAT_STENCIL_X86
+    case StencilISA::AVX2:
+        return StencilRow3DAVX2;
+    case StencilISA::AVX512:
+        return StencilRow3DAVX512;
+#endif
+    default:
+        return StencilRow3DScalar<Real>;
+    }
+}
+
+template <class Real>
+StencilRow3DStatsFunc<Real> StencilRow3DStatsKernel(StencilISA isa)
+{
+    if (!StencilSupported(isa))
+    {
+        return StencilRow3DStatsScalar<Real>;
+    }
+    switch (isa)
+    {
+#ifdef HEAT_STENCIL_X86
+    case StencilISA::AVX2:
+        return StencilRow3DStatsAVX2;
+    case StencilISA::AVX512:
+        return StencilRow3DStatsAVX512;
+#endif
+    default:
+        return StencilRow3DStatsScalar<Real>;
+    }
+}
+
+template <class Real>
+size_t StencilPaddedStride(size_t n)
+{
+    const size_t line = StencilAlignment / sizeof(Real);
+    size_t stride = (n + line - 1) / line * line;
+    // rows a multiple of 4KB apart map to the same cache sets, which makes
+    // the up/mid/down rows of the stencil evict each other
+    if ((stride * sizeof(Real)) % 4096 == 0)
+    {
+        stride += line;
+    }
+    return stride;
+}
+
+template <class Real>
+Real *StencilAlloc(size_t n)
+{
+    void *p = nullptr;
+    if (posix_memalign(&p, StencilAlignment, n * sizeof(Real)))
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<Real *>(p);
+}
+
+void StencilFree(void *p) { free(p); }
+
+StencilTile StencilTileSize(size_t nrows, size_t ncols, unsigned int levels,
+                            unsigned int threads, size_t elementSize)
+{
+    long l2 = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (l2 <= 0)
+    {
+        l2 = 1024 * 1024;
+    }
+
+    // Use half of L2 for a tile of both arrays
+    const size_t budget = l2 / 2 / (2 * elementSize);
+    StencilTile tile;
+    if (levels <= 1)
+    {
+        // Keep rows wide for long vector loops but short enough that the
+        // three rows of the source a row update reads are still in cache
+        // for the next row.
+        tile.cols = std::max<size_t>(1, std::min<size_t>(ncols, 2048));
+        tile.rows = std::max<size_t>(1, std::min(nrows, budget / tile.cols));
+    }
+    else
+    {
+        // A wavefront keeps levels+2 rows of the tile in flight
+        const size_t line = StencilAlignment / elementSize;
+        tile.rows = levels + 2;
+        tile.cols = std::max(line, budget / tile.rows / line * line);
+        // at least one tile per thread for the pipeline of the wavefront
+        const size_t share = (ncols + threads - 1) / threads;
+        tile.cols = std::min(tile.cols, (share + line - 1) / line * line);
+        tile.cols = std::min(tile.cols, ncols);
+    }
+    return tile;
+}
+
+template <class Real>
+void StencilSweep(Real *next, const Real *cur, size_t stride, size_t i0,
+                  size_t i1, size_t j0, size_t j1, const StencilTile &tile,
+                  StencilRowFunc<Real> kernel, Real omega,
+                  StencilRowStatsFunc<Real> statsKernel, StencilStats *stats)
+{
+#pragma omp parallel
+    {
+        StencilStats local;
+#pragma omp for schedule(static)
+        for (size_t ti = i0; ti < i1; ti += tile.rows)
+        {
+            const size_t tiEnd = std::min(ti + tile.rows, i1);
+            for (size_t tj = j0; tj < j1; tj += tile.cols)
+            {
+                const size_t n = std::min(tile.cols, j1 - tj);
+                for (size_t i = ti; i < tiEnd; ++i)
+                {
+                    const Real *mid = cur + i * stride + tj;
+                    if (stats)
+                        statsKernel(next + i * stride + tj, mid - stride, mid,
+                                    mid + stride, n, omega, local);
+                    else
+                        kernel(next + i * stride + tj, mid - stride, mid,
+                               mid + stride, n, omega);
+                }
+            }
+        }
+        if (stats)
+        {
+#pragma omp critical
+            stats->merge(local);
+        }
+    }
+}
+
+template <class Real>
+void StencilWavefront(Real *a, Real *b, size_t stride,
+                      const StencilRange *range, unsigned int levels,
+                      const StencilTile &tile, StencilRowFunc<Real> kernel,
+                      Real omega, StencilRowStatsFunc<Real> statsKernel,
+                      StencilStats *stats)
+{
+    ptrdiff_t imin = range[0].i0, imax = range[0].i1;
+    ptrdiff_t jmin = range[0].j0, jmax = range[0].j1;
+    for (unsigned int s = 1; s < levels; ++s)
+    {
+        imin = std::min(imin, range[s].i0);
+        imax = std::max(imax, range[s].i1);
+        jmin = std::min(jmin, range[s].j0);
+        jmax = std::max(jmax, range[s].j1);
+    }
+    const ptrdiff_t skew = levels - 1;
+    const ptrdiff_t w = tile.cols;
+    const ptrdiff_t ntiles = (jmax + skew - jmin + w - 1) / w;
+
+    // With threads the column tiles form a pipeline: row r of a tile needs
+    // row r of the tile on its left, which also finished reading the cells
+    // that row r of this tile overwrites.
+#pragma omp parallel
+    {
+        StencilStats local;
+#pragma omp for ordered(2) schedule(static, 1)
+        for (ptrdiff_t k = 0; k < ntiles; ++k)
+        {
+            for (ptrdiff_t r = imin; r < imax + skew; ++r)
+            {
+#pragma omp ordered depend(sink : k - 1, r)
+                const ptrdiff_t tj = jmin + k * w;
+                for (unsigned int s = 0; s < levels; ++s)
+                {
+                    const StencilRange &rg = range[s];
+                    const ptrdiff_t i = r - s;
+                    const ptrdiff_t j0 = std::max<ptrdiff_t>(tj - s, rg.j0);
+                    const ptrdiff_t j1 =
+                        std::min<ptrdiff_t>(tj + w - s, rg.j1);
+                    if (i < rg.i0 || i >= rg.i1 || j0 >= j1)
+                    {
+                        continue;
+                    }
+                    const Real *src = (s % 2 ? b : a);
+                    Real *dst = (s % 2 ? a : b);
+                    const Real *mid = src + i * (ptrdiff_t)stride + j0;
+                    if (stats && s == levels - 1)
+                        statsKernel(dst + i * (ptrdiff_t)stride + j0,
+                                    mid - stride, mid, mid + stride, j1 - j0,
+                                    omega, local);
+                    else
+                        kernel(dst + i * (ptrdiff_t)stride + j0, mid - stride,
+                               mid, mid + stride, j1 - j0, omega);
+                }
+#pragma omp ordered depend(source)
+            }
+        }
+        if (stats)
+        {
+#pragma omp critical
+            stats->merge(local);
+        }
+    }
+}
+
+template <class Real>
+void StencilWavefront3D(Real *a, Real *b, size_t stride, size_t planeStride,
+                        const StencilRange3D *range, unsigned int levels,
+                        StencilRow3DFunc<Real> kernel, Real omega,
+                        StencilRow3DStatsFunc<Real> statsKernel,
+                        StencilStats *stats)
+{
+    ptrdiff_t kmin = range[0].k0, kmax = range[0].k1;
+    for (unsigned int s = 1; s < levels; ++s)
+    {
+        kmin = std::min(kmin, range[s].k0);
+        kmax = std::max(kmax, range[s].k1);
+    }
+    const ptrdiff_t skew = levels - 1;
+    const ptrdiff_t ps = planeStride;
+
+    // Plane k of level s reads planes k-1..k+1 of level s-1, which the
+    // same or an earlier step r computed, and overwrites plane k of level
+    // s-2, whose last reader was plane k+1 of level s-1 in this step. The
+    // barrier after each plane keeps the threads in that order.
+#pragma omp parallel
+    {
+        StencilStats local;
+        for (ptrdiff_t r = kmin; r < kmax + skew; ++r)
+        {
+            for (unsigned int s = 0; s < levels; ++s)
+            {
+                const StencilRange3D &rg = range[s];
+                const ptrdiff_t k = r - s;
+                if (k < rg.k0 || k >= rg.k1 || rg.j0 >= rg.j1)
+                {
+                    continue;
+                }
+                const Real *src = (s % 2 ? b : a) + k * ps;
+                Real *dst = (s % 2 ? a : b) + k * ps;
+                const bool last = (stats && s == levels - 1);
+#pragma omp for schedule(static)
+                for (ptrdiff_t i = rg.i0; i < rg.i1; ++i)
+                {
+                    const ptrdiff_t o = i * (ptrdiff_t)stride + rg.j0;
+                    const Real *mid = src + o;
+                    if (last)
+                        statsKernel(dst + o, mid - stride, mid, mid + stride,
+                                    mid - ps, mid + ps, rg.j1 - rg.j0, omega,
+                                    local);
+                    else
+                        kernel(dst + o, mid - stride, mid, mid + stride,
+                               mid - ps, mid + ps, rg.j1 - rg.j0, omega);
+                }
+            }
+        }
+        if (stats)
+        {
+#pragma omp critical
+            stats->merge(local);
+        }
+    }
+}
+
+// the templates for the two element types of HeatTransfer
+#define HEAT_STENCIL_INSTANTIATE(Real)                                       \
+    template StencilRowFunc<Real> StencilRowKernel<Real>(StencilISA isa);    \
+    template StencilRowStatsFunc<Real> StencilRowStatsKernel<Real>(          \
+        StencilISA isa);                                                     \
+    template size_t StencilPaddedStride<Real>(size_t n);                     \
+    template Real *StencilAlloc<Real>(size_t n);                             \
+    template void StencilSweep<Real>(                                        \
+        Real *next, const Real *cur, size_t stride, size_t i0, size_t i1,    \
+        size_t j0, size_t j1, const StencilTile &tile,                       \
+        StencilRowFunc<Real> kernel, Real omega,                             \
+        StencilRowStatsFunc<Real> statsKernel, StencilStats *stats);         \
+    template void StencilWavefront<Real>(                                    \
+        Real *a, Real *b, size_t stride, const StencilRange *range,          \
+        unsigned int levels, const StencilTile &tile,                        \
+        StencilRowFunc<Real> kernel, Real omega,                             \
+        StencilRowStatsFunc<Real> statsKernel, StencilStats *stats);         \
+    template StencilRow3DFunc<Real> StencilRow3DKernel<Real>(                \
+        StencilISA isa);                                                     \
+    template StencilRow3DStatsFunc<Real> StencilRow3DStatsKernel<Real>(      \
+        StencilISA isa);                                                     \
+    template void StencilWavefront3D<Real>(                                  \
+        Real *a, Real *b, size_t stride, size_t planeStride,                 \
+        const StencilRange3D *range, unsigned int levels,                    \
+        StencilRow3DFunc<Real> kernel, Real omega,                           \
+        StencilRow3DStatsFunc<Real> statsKernel, StencilStats *stats);
+
+HEAT_STENCIL_INSTANTIATE(double)
+HEAT_STENCIL_INSTANTIATE(float)
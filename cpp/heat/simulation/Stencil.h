@@ -0,0 +1,192 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * Stencil.h
+ *
+ * Vectorized 5-point Jacobi kernels on flat 2D arrays with padded rows, and
+ * 7-point kernels on 3D arrays of such planes, of double or float (Real)
+ * cells. The templates are instantiated for both in Stencil.cpp.
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifndef STENCIL_H_
+#define STENCIL_H_
+
+#include <cstddef>
+
+/* Instruction sets we have a row kernel for */
+enum class StencilISA
+{
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+/* Weighted Jacobi update of one row segment of n elements:
+ *   next[j] = omega/4 * (up[j] + down[j] + mid[j-1] + mid[j+1])
+ *             + (1-omega) * mid[j]
+ * mid[-1] and mid[n] must be readable. It is computed in Real.
+ */
+template <class Real>
+using StencilRowFunc = void (*)(Real *next, const Real *up, const Real *mid,
+                                const Real *down, size_t n, Real omega);
+
+/* Statistics of the cells a sweep updated, of their new values and of
+ * their change in that sweep. The sums are accumulated in double for
+ * either Real.
+ */
+struct StencilStats
+{
+    double min = 1.0e300;
+    double max = -1.0e300;
+    double sum = 0.0;       // sum of the new values
+    double change2 = 0.0;   // sum of the squared changes
+    double changeMax = 0.0; // largest absolute change
+    size_t cells = 0;
+
+    void merge(const StencilStats &o);
+};
+
+/* A StencilRowFunc that also adds the n updated cells to stats */
+template <class Real>
+using StencilRowStatsFunc = void (*)(Real *next, const Real *up,
+                                     const Real *mid, const Real *down,
+                                     size_t n, Real omega,
+                                     StencilStats &stats);
+
+/* Weighted Jacobi update of one row segment of n elements of a 3D array,
+ * with front and back the same row in the previous and the next plane:
+ *   next[j] = omega/6 * (up[j] + down[j] + mid[j-1] + mid[j+1] + front[j]
+ *                        + back[j]) + (1-omega) * mid[j]
+ */
+template <class Real>
+using StencilRow3DFunc = void (*)(Real *next, const Real *up,
+                                  const Real *mid, const Real *down,
+                                  const Real *front, const Real *back,
+                                  size_t n, Real omega);
+
+/* A StencilRow3DFunc that also adds the n updated cells to stats */
+template <class Real>
+using StencilRow3DStatsFunc = void (*)(Real *next, const Real *up,
+                                       const Real *mid, const Real *down,
+                                       const Real *front, const Real *back,
+                                       size_t n, Real omega,
+                                       StencilStats &stats);
+
+/* Cache tile of a sweep: number of rows and columns updated together */
+struct StencilTile
+{
+    size_t rows;
+    size_t cols;
+};
+
+/* Rows [i0,i1) and columns [j0,j1) updated in one time level of a
+ * wavefront, relative to row 0 and column 0 of the arrays (may be negative)
+ */
+struct StencilRange
+{
+    ptrdiff_t i0;
+    ptrdiff_t i1;
+    ptrdiff_t j0;
+    ptrdiff_t j1;
+};
+
+/* Planes [k0,k1), rows [i0,i1) and columns [j0,j1) updated in one time
+ * level of a 3D wavefront, relative to plane, row and column 0
+ */
+struct StencilRange3D
+{
+    ptrdiff_t k0;
+    ptrdiff_t k1;
+    ptrdiff_t i0;
+    ptrdiff_t i1;
+    ptrdiff_t j0;
+    ptrdiff_t j1;
+};
+
+// Alignment of every row of an array in bytes (one cache line)
+const size_t StencilAlignment = 64;
+
+// The fastest instruction set of this CPU we have a kernel for
+StencilISA StencilDetectISA();
+// true if this CPU can run the kernel of the given instruction set
+bool StencilSupported(StencilISA isa);
+const char *StencilISAName(StencilISA isa);
+template <class Real>
+StencilRowFunc<Real> StencilRowKernel(StencilISA isa);
+template <class Real>
+StencilRowStatsFunc<Real> StencilRowStatsKernel(StencilISA isa);
+template <class Real>
+StencilRow3DFunc<Real> StencilRow3DKernel(StencilISA isa);
+template <class Real>
+StencilRow3DStatsFunc<Real> StencilRow3DStatsKernel(StencilISA isa);
+
+// Row stride (in elements) for rows of n elements, multiple of the alignment
+template <class Real>
+size_t StencilPaddedStride(size_t n);
+// Allocate/free an array of n elements aligned to StencilAlignment
+template <class Real>
+Real *StencilAlloc(size_t n);
+void StencilFree(void *p);
+
+// Tile size for sweeping nrows x ncols elements of elementSize bytes so
+// that a tile of the source and the destination array stays in the L2
+// cache. With more than one level the tile is sized for a
+// StencilWavefront() of that many levels run by the given number of
+// threads.
+StencilTile StencilTileSize(size_t nrows, size_t ncols,
+                            unsigned int levels = 1, unsigned int threads = 1,
+                            size_t elementSize = sizeof(double));
+
+/* One Jacobi sweep over rows [i0,i1) and columns [j0,j1) of 2D arrays
+ * with 'stride' elements per row, reading 'cur' and writing 'next',
+ * processing the region tile by tile. With OpenMP the rows of tiles are
+ * split statically over the threads. With stats, statsKernel updates the
+ * rows and their statistics are added to stats in the same pass.
+ */
+template <class Real>
+void StencilSweep(Real *next, const Real *cur, size_t stride, size_t i0,
+                  size_t i1, size_t j0, size_t j1, const StencilTile &tile,
+                  StencilRowFunc<Real> kernel, Real omega,
+                  StencilRowStatsFunc<Real> statsKernel = nullptr,
+                  StencilStats *stats = nullptr);
+
+/* Temporal blocking: advance 'levels' Jacobi sweeps in one pass over the
+ * arrays. Level s (0 <= s < levels) updates range[s], reading level s-1
+ * from one array and overwriting level s-2 in the other; level 0 is read
+ * from 'a', so the result ends up in 'b' if 'levels' is odd, in 'a'
+ * otherwise. The cells around range[s] must be in range[s-1] or hold
+ * constant boundary values in both arrays. Columns are processed in tiles
+ * of tile.cols skewed by one column per level, and within a tile the
+ * levels advance down the rows as a wavefront skewed by one row per level,
+ * so each cell is brought into cache once for all levels. With OpenMP the
+ * tiles are distributed over the threads and advance as a pipeline. With
+ * stats, the last level is updated by statsKernel and its statistics are
+ * added to stats.
+ */
+template <class Real>
+void StencilWavefront(Real *a, Real *b, size_t stride,
+                      const StencilRange *range, unsigned int levels,
+                      const StencilTile &tile, StencilRowFunc<Real> kernel,
+                      Real omega,
+                      StencilRowStatsFunc<Real> statsKernel = nullptr,
+                      StencilStats *stats = nullptr);
+
+/* The 3D form of StencilWavefront(): 'levels' sweeps of the 7-point
+ * stencil over arrays of planes 'planeStride' elements apart, each of rows
+ * 'stride' elements apart. The levels advance through the planes as a
+ * wavefront skewed by one plane per level, so the planes of all levels
+ * are read from cache while levels+2 planes of a thread's rows fit in it.
+ * The rows of a plane are split statically over the OpenMP threads. With
+ * one level this is a plain sweep from 'a' into 'b'.
+ */
+template <class Real>
+void StencilWavefront3D(Real *a, Real *b, size_t stride, size_t planeStride,
+                        const StencilRange3D *range, unsigned int levels,
+                        StencilRow3DFunc<Real> kernel, Real omega,
+                        StencilRow3DStatsFunc<Real> statsKernel = nullptr,
+                        StencilStats *stats = nullptr);
+
+#endif /* STENCIL_H_ */
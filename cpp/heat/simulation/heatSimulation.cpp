@@ -11,33 +11,512 @@
  *
  */
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
+#include "Balance.h"
+#include "Convergence.h"
 #include "HeatTransfer.h"
 #include "IO.h"
 #include "Settings.h"
+#include "Solver.h"
 
 void printUsage()
 {
     std::cout
         << "Usage: heatSimulation   output  N  M   nx  ny   steps "
-           "iterations\n"
+           "iterations [options]\n"
         << "  output: name of output data file/stream\n"
         << "  N:      number of processes in X dimension\n"
         << "  M:      number of processes in Y dimension\n"
         << "  nx:     local array size in X dimension per processor\n"
         << "  ny:     local array size in Y dimension per processor\n"
         << "  steps:  the total number of steps to output\n"
-        << "  iterations: one step consist of this many iterations\n\n";
+        << "  iterations: one step consist of this many iterations\n"
+        << "Options:\n"
+        << "  --tblock k: do k iterations between two exchanges of k ghost "
+           "layers (default 1)\n"
+        << "  --verify:   check the results against the default settings "
+           "in every step\n"
+        << "  --exchange blocking|nonblocking|persistent|neighbor|shared: "
+           "MPI calls used for the ghost cells\n"
+        << "  --overlap:  compute the interior while ghost cells are in "
+           "flight\n"
+        << "  --cart:     let MPI_Cart_create place the processes of the "
+           "grid\n"
+        << "  --periodic: periodic plate without edges (needs a non-blocking "
+           "exchange)\n"
+        << "  --threads n: OpenMP threads per process (default 1)\n"
+        << "  --pin:      pin the threads to the cores the process may run "
+           "on\n"
+        << "  --async:    write output in a background thread while the "
+           "simulation continues\n"
+        << "  --async-steps n: output steps in flight with --async (default "
+           "2)\n"
+        << "  --hugepages: put the staging buffers of --async in huge "
+           "pages\n"
+        << "  --checkpoint s: write a checkpoint after the output step when "
+           "s seconds passed since the last one (implies --async)\n"
+        << "  --checkpoint-file name: checkpoint file (default: "
+           "output.ckpt)\n"
+        << "  --restart:  continue from the last checkpoint, appending to "
+           "the output\n"
+        << "              the steps the interrupted run did not write\n"
+        << "  --compress type[:key=value,...]: compress T in the output with "
+           "the zfp, sz or blosc\n"
+        << "              operator, e.g. zfp:accuracy=0.0001, zfp:rate=8, "
+           "sz:accuracy=0.001, blosc:clevel=5\n"
+        << "  --decimate n: also output Tdecimated, every n-th cell of T in "
+           "both dimensions\n"
+        << "  --average n: also output Tdecimated, the mean of n x n blocks "
+           "of T\n"
+        << "  --roi x,y,nx,ny: also output Troi, the nx x ny box of T at "
+           "global offset x,y\n"
+        << "  --full-every k: output the full T only every k-th step, never "
+           "if 0 (default 1)\n"
+        << "  --stats:    output Tmin, Tmax, Tmean and Tchange of every "
+           "block with every step\n"
+        << "  --tolerance e: stop when the change of T in an iteration is "
+           "below e\n"
+        << "  --check-every n: check the change every n iterations "
+           "(default 10)\n"
+        << "  --residual max|l2: norm of the change (default max)\n"
+        << "  --converged-every k: after convergence continue, output every "
+           "k-th step\n"
+        << "  --solver jacobi|cg|multigrid: Jacobi relaxation (default), "
+           "conjugate\n"
+        << "              gradients or multigrid V-cycles, iterations counts "
+           "CG iterations\n"
+        << "              or V-cycles\n"
+        << "  --smoothing n: Jacobi sweeps before and after the coarse grid "
+           "correction\n"
+        << "              of a V-cycle (default 2)\n"
+        << "  --precision double|float: storage of T in the stencil and the "
+           "output (default\n"
+        << "              double), --verify reports the accuracy of float\n"
+        << "  --3d P,nz:  3D volume of P*nz planes, decomposed N*M*P, with a "
+           "7-point stencil\n"
+        << "  --blocks x1,...,xN:y1,...,yM: rows of the processes at each "
+           "position in X and\n"
+        << "              columns of those at each position in Y, instead of "
+           "nx and ny\n"
+        << "  --rebalance k: resize the blocks to the speed of the processes "
+           "every k-th step\n"
+        << "  --init analytic|random[:seed]|file:name[:step]: initial T, the "
+           "default waves,\n"
+        << "              random values, or T of a step of an ADIOS2 file "
+           "(default the last)\n\n";
+}
+
+/* Set the number of OpenMP threads and pin them if asked for, before the
+ * arrays are allocated so that first touch places them with their threads.
+ * Thread t is pinned to the CPU t*n/threads of the n CPUs in the affinity
+ * mask mpirun gave to the process.
+ */
+void startThreads(const Settings &settings)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(settings.threads);
+#ifdef __linux__
+    if (settings.pin)
+    {
+        cpu_set_t allowed;
+        sched_getaffinity(0, sizeof(allowed), &allowed);
+        std::vector<int> cpus;
+        for (int c = 0; c < CPU_SETSIZE; ++c)
+            if (CPU_ISSET(c, &allowed))
+                cpus.push_back(c);
+#pragma omp parallel
+        {
+            const size_t t = omp_get_thread_num();
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[t * cpus.size() / settings.threads], &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+    }
+#endif
+#endif
+}
+
+/* Advance the simulation by the given number of iterations, doing
+ * settings.tblock iterations between two exchanges, and with withStats
+ * keep the statistics of the last iteration in ht.stats(). With conv, the
+ * convergence is checked on the way and the simulation stops early once
+ * it has converged. iteration counts the iterations of the whole run.
+ * @return the number of iterations done
+ */
+template <class Real>
+unsigned int advance(HeatTransfer<Real> &ht, const Settings &settings,
+                     unsigned int iterations, MPI_Comm comm,
+                     bool withStats = false, Convergence *conv = nullptr,
+                     unsigned long iteration = 0)
+{
+    unsigned int iter = 0;
+    while (iter < iterations)
+    {
+        const unsigned int n =
+            (settings.overlap ? 1 : std::min(settings.tblock,
+                                             iterations - iter));
+        iter += n;
+        const bool check = conv && conv->due(iteration + iter);
+        const bool last = (iter == iterations);
+        if (settings.overlap)
+        {
+            ht.iterateOverlap(comm, (withStats && last) || check);
+        }
+        else
+        {
+            ht.iterate(n, (withStats && last) || check);
+            ht.exchange(comm);
+        }
+        ht.heatEdges();
+        if (check && conv->check(ht.stats(), iteration + iter) &&
+            !settings.convergedEvery)
+        {
+            break;
+        }
+    }
+    return iter;
+}
+
+/* Advance the simulation by the given number of iterations of the solver
+ * and update the ghost cells, with withStats keeping the statistics of the
+ * result in ht.stats() (with no change).
+ * @return the number of iterations done
+ */
+template <class Real>
+unsigned int solve(HeatTransfer<Real> &ht, Solver &solver,
+                   unsigned int iterations, MPI_Comm comm,
+                   bool withStats = false)
+{
+    solver.iterate(ht, iterations);
+    ht.exchange(comm);
+    ht.heatEdges();
+    if (withStats)
+        ht.computeStats();
+    return iterations;
+}
+
+/* Largest and RMS difference between the local arrays of two simulations
+ * over all processes, which may differ in precision
+ */
+template <class A, class B>
+void difference(const HeatTransfer<A> &a, const HeatTransfer<B> &b,
+                const Settings &settings, MPI_Comm comm, double &max,
+                double &rms)
+{
+    double d[2] = {0.0, 0.0};
+    for (unsigned int k = 1; k <= settings.ndz; ++k)
+        for (unsigned int i = 1; i <= settings.ndx; ++i)
+            for (unsigned int j = 1; j <= settings.ndy; ++j)
+            {
+                const double e =
+                    std::fabs((double)a.T(k, i, j) - (double)b.T(k, i, j));
+                d[0] = std::max(d[0], e);
+                d[1] += e * e;
+            }
+    MPI_Allreduce(MPI_IN_PLACE, &d[0], 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(MPI_IN_PLACE, &d[1], 1, MPI_DOUBLE, MPI_SUM, comm);
+    max = d[0];
+    rms = std::sqrt(d[1] /
+                    ((double)settings.gndz * settings.gndx * settings.gndy));
+}
+
+/* Resize the blocks to the speed of the processes if the balancer expects
+ * a gain: the local arrays of ht and of the reference are moved to the new
+ * blocks of settings and refSettings and rebuilt there, and the output
+ * continues on them. sweepTime is the ht->sweepTime() of the last call.
+ * @return true if the blocks changed
+ */
+template <class Real>
+bool rebalance(Balancer &balancer, Settings &settings,
+               std::unique_ptr<HeatTransfer<Real>> &ht, Settings &refSettings,
+               std::unique_ptr<HeatTransfer<double>> &ref, IO<Real> &io,
+               double &sweepTime, MPI_Comm comm)
+{
+    const bool move =
+        balancer.plan(settings, ht->sweepTime() - sweepTime);
+    sweepTime = ht->sweepTime();
+    if (!move)
+    {
+        return false;
+    }
+    // the staging buffers in flight hold the old blocks
+    io.flush();
+    const std::vector<Real> block =
+        balancer.migrate(settings, ht->data_noghost());
+    ht.reset();
+    settings.Resize(balancer.blockx(), balancer.blocky());
+    ht.reset(new HeatTransfer<Real>(settings, comm));
+    ht->set_noghost(block.data());
+    ht->heatEdges();
+    ht->exchange(comm);
+    sweepTime = 0.0;
+    if (ref)
+    {
+        const std::vector<double> d =
+            balancer.migrate(refSettings, ref->data_noghost());
+        ref.reset();
+        refSettings.Resize(balancer.blockx(), balancer.blocky());
+        ref.reset(new HeatTransfer<double>(refSettings, comm));
+        ref->set_noghost(d.data());
+        ref->heatEdges();
+        ref->exchange(comm);
+    }
+    io.resize();
+    return true;
+}
+
+/* The simulation in Real precision, after the process grid and the
+ * threads are set up. settings is a copy, rebalancing changes its blocks.
+ */
+template <class Real>
+void run(Settings settings, MPI_Comm mpiHeatTransferComm, double timeStart)
+{
+    const int rank = settings.rank;
+    std::unique_ptr<HeatTransfer<Real>> ht(
+        new HeatTransfer<Real>(settings, mpiHeatTransferComm));
+    IO<Real> io(settings, mpiHeatTransferComm);
+    std::unique_ptr<Solver> solver =
+        CreateSolver(settings, mpiHeatTransferComm);
+    if (!rank)
+    {
+        std::cout << "Stencil kernel         : " << ht->kernelName()
+                  << std::endl;
+        if (solver)
+            std::cout << "Solver                 : "
+                      << solver->description() << std::endl;
+        if (io.stagingPool())
+            std::cout << "Staging buffers        : "
+                      << io.stagingPool()->size()
+                      << (io.stagingPool()->hugePages()
+                              ? " in huge pages"
+                              : "")
+                      << std::endl;
+    }
+
+    unsigned int step0 = 0;
+    unsigned long iteration = 0;
+    if (settings.restart)
+    {
+        step0 = io.restart(*ht, iteration, mpiHeatTransferComm);
+        if (rank == 0)
+            std::cout << "Restarting from step " << step0 << " of "
+                      << settings.checkpointFile << "\n";
+    }
+    else
+    {
+        if (rank == 0)
+            std::cout << "Simulation step 0: initialization\n";
+        if (settings.init == InitType::File)
+            io.readInitial(*ht, mpiHeatTransferComm);
+        else
+            ht->init(false, mpiHeatTransferComm);
+    }
+    // ht.printT("Initialized T:", mpiHeatTransferComm);
+    ht->heatEdges();
+    if (settings.stats)
+        ht->computeStats();
+    ht->exchange(mpiHeatTransferComm);
+    // ht.printT("Heated T:", mpiHeatTransferComm);
+
+    // Reference simulation with the default blocking exchange (or
+    // non-blocking on a periodic plate), on the same grid, and no
+    // temporal blocking for --verify, always in double
+    Settings refSettings(settings);
+    refSettings.singlePrecision = false;
+    refSettings.tblock = 1;
+    refSettings.exchange = (settings.periodic ? ExchangeMode::NonBlocking
+                                              : ExchangeMode::Blocking);
+    refSettings.overlap = false;
+    std::unique_ptr<HeatTransfer<double>> ref;
+    double worstMax = 0.0, worstRms = 0.0;
+    if (settings.verify)
+    {
+        ref.reset(new HeatTransfer<double>(refSettings, mpiHeatTransferComm));
+        if (settings.restart || settings.init == InitType::File)
+        {
+            const std::vector<Real> t = ht->data_noghost();
+            const std::vector<double> d(t.begin(), t.end());
+            ref->set_noghost(d.data());
+        }
+        else
+            ref->init(false, mpiHeatTransferComm);
+        ref->heatEdges();
+        ref->exchange(mpiHeatTransferComm);
+    }
+
+    // a restarted run has written the checkpointed step already
+    double timeIO = MPI_Wtime();
+    if (!settings.restart)
+        io.write(0, *ht, settings);
+    timeIO = MPI_Wtime() - timeIO;
+    double timeCompute = 0.0;
+    double lastCheckpoint = MPI_Wtime();
+    Convergence conv(settings, mpiHeatTransferComm);
+    std::unique_ptr<Balancer> balancer;
+    if (settings.rebalance)
+        balancer.reset(new Balancer(settings, mpiHeatTransferComm));
+    double sweepTime = 0.0, timeBalance = 0.0;
+    unsigned int rebalances = 0;
+
+    for (unsigned int t = step0 + 1; t < settings.steps; ++t)
+    {
+        if (rank == 0)
+            std::cout << "Simulation step " << t << "\n";
+        double timeStep = MPI_Wtime();
+        const bool wasConverged = conv.converged();
+        const unsigned int done =
+            solver ? solve(*ht, *solver, settings.iterations,
+                           mpiHeatTransferComm, settings.stats)
+                   : advance(*ht, settings, settings.iterations,
+                             mpiHeatTransferComm, settings.stats, &conv,
+                             iteration);
+        iteration += done;
+        timeCompute += MPI_Wtime() - timeStep;
+        if (conv.converged() && !wasConverged && rank == 0)
+        {
+            std::cout << "  converged: residual " << conv.residual()
+                      << " at iteration " << conv.iteration() << "\n";
+        }
+        const bool stop = conv.converged() && !settings.convergedEvery;
+
+        if (ref)
+        {
+            advance(*ref, refSettings, done, mpiHeatTransferComm);
+            double dmax, drms;
+            difference(*ht, *ref, settings, mpiHeatTransferComm, dmax, drms);
+            worstMax = std::max(worstMax, dmax);
+            worstRms = std::max(worstRms, drms);
+            if (rank == 0)
+                std::cout << "  max difference from reference: " << dmax
+                          << ", rms " << drms << "\n";
+        }
+
+        // after convergence only every convergedEvery-th step, but
+        // the last one of the run
+        if (wasConverged && settings.convergedEvery &&
+            t % settings.convergedEvery &&
+            t + 1 < settings.steps)
+        {
+            continue;
+        }
+        timeStep = MPI_Wtime();
+        io.write(t, *ht, settings);
+
+        // rank 0's clock decides, so that all processes checkpoint
+        // the same steps
+        if (settings.checkpointInterval > 0)
+        {
+            int due = (MPI_Wtime() - lastCheckpoint >=
+                       settings.checkpointInterval);
+            MPI_Bcast(&due, 1, MPI_INT, 0, mpiHeatTransferComm);
+            if (due)
+            {
+                io.checkpoint(t, iteration, *ht);
+                lastCheckpoint = MPI_Wtime();
+            }
+        }
+        timeIO += MPI_Wtime() - timeStep;
+        if (stop)
+        {
+            break;
+        }
+
+        if (balancer && t % settings.rebalance == 0 &&
+            t + 1 < settings.steps)
+        {
+            timeStep = MPI_Wtime();
+            if (rebalance(*balancer, settings, ht, refSettings, ref, io,
+                          sweepTime, mpiHeatTransferComm))
+            {
+                ++rebalances;
+                if (rank == 0)
+                    std::cout << "  rebalanced: slowest/mean "
+                              << balancer->imbalance() << " -> "
+                              << balancer->plannedImbalance()
+                              << " expected\n";
+            }
+            timeBalance += MPI_Wtime() - timeStep;
+        }
+    }
+    double timeStep = MPI_Wtime();
+    io.flush();
+    timeIO += MPI_Wtime() - timeStep;
+    io.close();
+    MPI_Barrier(mpiHeatTransferComm);
+
+    double timeEnd = MPI_Wtime();
+    // time of the output the simulation waited for, of the output done
+    // in the background while it continued, and of the output steps
+    double times[4] = {timeCompute, timeIO,
+                       io.backgroundTime() - io.waitTime(),
+                       io.writeTime()};
+    double maxTimes[4];
+    MPI_Reduce(times, maxTimes, 4, MPI_DOUBLE, MPI_MAX, 0,
+               mpiHeatTransferComm);
+    unsigned long rawBytes = io.rawBytes();
+    unsigned long totalRawBytes;
+    MPI_Reduce(&rawBytes, &totalRawBytes, 1, MPI_UNSIGNED_LONG, MPI_SUM,
+               0, mpiHeatTransferComm);
+    // output steps with the full T
+    const size_t written = io.fullSteps();
+    if (rank == 0)
+    {
+        std::cout << "Computation and exchange = " << maxTimes[0]
+                  << "s\n";
+        std::cout << "Output = " << maxTimes[1] << "s\n";
+        std::cout << "Output per step = " << maxTimes[1] / settings.steps
+                  << "s exposed, " << maxTimes[2] / settings.steps
+                  << "s hidden\n";
+        const double rawMB = totalRawBytes / 1048576.0;
+        if (written)
+            std::cout << "Write per step = " << maxTimes[3] / written
+                      << "s, " << rawMB / maxTimes[3] << " MB/s of T\n";
+        const size_t diskBytes = io.outputBytes();
+        if (!io.compression().empty() && diskBytes && !settings.restart)
+        {
+            std::cout << "Compression (" << io.compression()
+                      << ") ratio = " << totalRawBytes / (double)diskBytes
+                      << ", " << rawMB << " MB to "
+                      << diskBytes / 1048576.0 << " MB on disk\n";
+        }
+        if (balancer)
+            std::cout << "Rebalancing = " << timeBalance << "s, "
+                      << rebalances << " times\n";
+        if (ref)
+            std::cout << "Largest difference from the double reference = "
+                      << worstMax << ", rms " << worstRms << "\n";
+        std::cout << "Total runtime = " << timeEnd - timeStart << "s\n";
+    }
 }
 
 int main(int argc, char *argv[])
 {
-    MPI_Init(&argc, &argv);
+    // only the main thread calls MPI, except for the background output
+    // thread of --async (which --checkpoint turns on)
+    const bool async =
+        std::find(argv + 1, argv + argc, std::string("--async")) !=
+            argv + argc ||
+        std::find(argv + 1, argv + argc, std::string("--checkpoint")) !=
+            argv + argc;
+    int provided;
+    MPI_Init_thread(&argc, &argv,
+                    async ? MPI_THREAD_MULTIPLE : MPI_THREAD_FUNNELED,
+                    &provided);
 
     /* When writer and reader is launched together with a single mpirun command,
        the world comm spans all applications. We have to split and create the
@@ -62,49 +541,47 @@ int main(int argc, char *argv[])
     {
         double timeStart = MPI_Wtime();
         Settings settings(argc, argv, rank, nproc);
+        if (settings.cart)
+        {
+            MPI_Comm cartComm = settings.CreateCartComm(mpiHeatTransferComm);
+            MPI_Comm_free(&mpiHeatTransferComm);
+            mpiHeatTransferComm = cartComm;
+            rank = settings.rank;
+        }
+        startThreads(settings);
         if (!rank)
         {
             std::cout << "Process decomposition  : " << settings.npx << " x "
-                      << settings.npy << std::endl;
+                      << settings.npy;
+            if (settings.threeD)
+                std::cout << " x " << settings.npz;
+            std::cout << (settings.cart ? " cartesian" : "")
+                      << (settings.periodic ? " periodic" : "") << std::endl;
             std::cout << "Array size per process : " << settings.ndx << " x "
-                      << settings.ndy << std::endl;
+                      << settings.ndy;
+            if (settings.threeD)
+                std::cout << " x " << settings.ndz;
+            if (!settings.UniformBlocks())
+                std::cout << " on rank 0, global " << settings.gndx << " x "
+                          << settings.gndy;
+            std::cout << std::endl;
             std::cout << "Number of output steps : " << settings.steps
                       << std::endl;
             std::cout << "Iterations per step    : " << settings.iterations
                       << std::endl;
+            std::cout << "Iterations per exchange: " << settings.tblock
+                      << std::endl;
+            std::cout << "Threads per process    : " << settings.threads
+                      << (settings.pin ? " pinned" : "") << std::endl;
+            std::cout << "Precision of T         : "
+                      << (settings.singlePrecision ? "float" : "double")
+                      << std::endl;
         }
 
-        HeatTransfer ht(settings);
-        IO io(settings, mpiHeatTransferComm);
-
-        if (rank == 0)
-            std::cout << "Simulation step 0: initialization\n";
-        ht.init(false, mpiHeatTransferComm);
-        // ht.printT("Initialized T:", mpiHeatTransferComm);
-        ht.heatEdges();
-        ht.exchange(mpiHeatTransferComm);
-        // ht.printT("Heated T:", mpiHeatTransferComm);
-
-        io.write(0, ht, settings, mpiHeatTransferComm);
-
-        for (unsigned int t = 1; t < settings.steps; ++t)
-        {
-            if (rank == 0)
-                std::cout << "Simulation step " << t << "\n";
-            for (unsigned int iter = 1; iter <= settings.iterations; ++iter)
-            {
-                ht.iterate();
-                ht.exchange(mpiHeatTransferComm);
-                ht.heatEdges();
-            }
-
-            io.write(t, ht, settings, mpiHeatTransferComm);
-        }
-        MPI_Barrier(mpiHeatTransferComm);
-
-        double timeEnd = MPI_Wtime();
-        if (rank == 0)
-            std::cout << "Total runtime = " << timeEnd - timeStart << "s\n";
+        if (settings.singlePrecision)
+            run<float>(settings, mpiHeatTransferComm, timeStart);
+        else
+            run<double>(settings, mpiHeatTransferComm, timeStart);
     }
     catch (std::invalid_argument &e) // command-line argument errors
     {
@@ -0,0 +1,355 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * stencilBenchmark.cpp
+ *
+ * Micro-benchmark of the Jacobi stencil kernels of heatSimulation on a
+ * single core. Every kernel variant runs the same number of sweeps on the
+ * same data and is compared against the original double** kernel. The
+ * "stats" variants also compute the statistics of every sweep, the
+ * "float" variants run on float arrays. With nz, the 3D 7-point kernels
+ * are measured on an nz*nx*ny volume as well, plain and as a wavefront of
+ * 4 levels.
+ *
+ *  Created on: Oct 2026
+ */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Stencil.h"
+
+static const double omega = 0.8;
+
+void printUsage()
+{
+    std::cout << "Usage: heatStencilBench  nx  ny  sweeps  [nz]\n"
+              << "  nx:     array size in X dimension\n"
+              << "  ny:     array size in Y dimension\n"
+              << "  sweeps: number of Jacobi sweeps per kernel variant\n"
+              << "  nz:     array size in Z dimension of the 3D kernels\n\n";
+}
+
+static double initValue(size_t i, size_t j)
+{
+    return 100.0 + 100.0 * std::sin(0.05 * i) * std::cos(0.03 * j);
+}
+
+static double initValue(size_t k, size_t i, size_t j)
+{
+    return initValue(i, j) + 10.0 * std::cos(0.07 * k);
+}
+
+/* The kernel HeatTransfer::iterate() used before, on double** rows */
+static double runReference(size_t nx, size_t ny, unsigned int sweeps,
+                           std::vector<double> &result)
+{
+    std::vector<double> a((nx + 2) * (ny + 2)), b((nx + 2) * (ny + 2));
+    std::vector<double *> ra(nx + 2), rb(nx + 2);
+    for (size_t i = 0; i < nx + 2; ++i)
+    {
+        ra[i] = &a[i * (ny + 2)];
+        rb[i] = &b[i * (ny + 2)];
+        for (size_t j = 0; j < ny + 2; ++j)
+        {
+            ra[i][j] = rb[i][j] = initValue(i, j);
+        }
+    }
+    double **cur = ra.data();
+    double **next = rb.data();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int s = 0; s < sweeps; ++s)
+    {
+        for (size_t i = 1; i <= nx; ++i)
+        {
+            for (size_t j = 1; j <= ny; ++j)
+            {
+                next[i][j] = omega / 4 * (cur[i - 1][j] + cur[i + 1][j] +
+                                          cur[i][j - 1] + cur[i][j + 1]) +
+                             (1.0 - omega) * cur[i][j];
+            }
+        }
+        std::swap(cur, next);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.resize(nx * ny);
+    for (size_t i = 1; i <= nx; ++i)
+        for (size_t j = 1; j <= ny; ++j)
+            result[(i - 1) * ny + j - 1] = cur[i][j];
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/* The flat, padded array kernels of Stencil.h on Real arrays */
+template <class Real>
+static double runKernel(size_t nx, size_t ny, unsigned int sweeps,
+                        StencilISA isa, bool tiled, bool withStats,
+                        const std::vector<double> &reference, double &maxdiff)
+{
+    const size_t stride = StencilPaddedStride<Real>(ny + 2);
+    Real *a = StencilAlloc<Real>((nx + 2) * stride);
+    Real *b = StencilAlloc<Real>((nx + 2) * stride);
+    for (size_t i = 0; i < nx + 2; ++i)
+    {
+        for (size_t j = 0; j < stride; ++j)
+        {
+            a[i * stride + j] = b[i * stride + j] =
+                Real(j < ny + 2 ? initValue(i, j) : 0.0);
+        }
+    }
+    StencilTile tile = StencilTileSize(nx, ny, 1, 1, sizeof(Real));
+    if (!tiled)
+    {
+        tile.rows = nx;
+        tile.cols = ny;
+    }
+    StencilRowFunc<Real> kernel = StencilRowKernel<Real>(isa);
+    StencilRowStatsFunc<Real> statsKernel = StencilRowStatsKernel<Real>(isa);
+    StencilStats stats;
+    Real *cur = a;
+    Real *next = b;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int s = 0; s < sweeps; ++s)
+    {
+        StencilSweep(next, cur, stride, 1, nx + 1, 1, ny + 1, tile, kernel,
+                     Real(omega), statsKernel, withStats ? &stats : nullptr);
+        std::swap(cur, next);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    maxdiff = 0.0;
+    for (size_t i = 1; i <= nx; ++i)
+        for (size_t j = 1; j <= ny; ++j)
+            maxdiff = std::max(maxdiff,
+                               std::fabs(cur[i * stride + j] -
+                                         reference[(i - 1) * ny + j - 1]));
+    StencilFree(a);
+    StencilFree(b);
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/* The 7-point stencil on a flat (nz+2) * (nx+2) * (ny+2) double array */
+static double runReference3D(size_t nx, size_t ny, size_t nz,
+                             unsigned int sweeps, std::vector<double> &result)
+{
+    const size_t sj = 1, si = ny + 2, sk = (nx + 2) * (ny + 2);
+    std::vector<double> a((nz + 2) * sk), b((nz + 2) * sk);
+    for (size_t k = 0; k < nz + 2; ++k)
+        for (size_t i = 0; i < nx + 2; ++i)
+            for (size_t j = 0; j < ny + 2; ++j)
+                a[k * sk + i * si + j] = b[k * sk + i * si + j] =
+                    initValue(k, i, j);
+    double *cur = a.data();
+    double *next = b.data();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int s = 0; s < sweeps; ++s)
+    {
+        for (size_t k = 1; k <= nz; ++k)
+            for (size_t i = 1; i <= nx; ++i)
+                for (size_t j = 1; j <= ny; ++j)
+                {
+                    const double *c = cur + k * sk + i * si + j;
+                    next[k * sk + i * si + j] =
+                        omega / 6 *
+                            (c[-si] + c[si] + c[-sj] + c[sj] + c[-sk] +
+                             c[sk]) +
+                        (1.0 - omega) * c[0];
+                }
+        std::swap(cur, next);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.resize(nz * nx * ny);
+    for (size_t k = 1; k <= nz; ++k)
+        for (size_t i = 1; i <= nx; ++i)
+            for (size_t j = 1; j <= ny; ++j)
+                result[((k - 1) * nx + i - 1) * ny + j - 1] =
+                    cur[k * sk + i * si + j];
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/* The 3D kernels of Stencil.h in passes of up to 'levels' sweeps */
+template <class Real>
+static double runKernel3D(size_t nx, size_t ny, size_t nz,
+                          unsigned int sweeps, StencilISA isa,
+                          unsigned int levels,
+                          const std::vector<double> &reference,
+                          double &maxdiff)
+{
+    const size_t stride = StencilPaddedStride<Real>(ny + 2);
+    const size_t planeStride = (nx + 2) * stride;
+    const size_t n = (nz + 2) * planeStride;
+    Real *a = StencilAlloc<Real>(n);
+    Real *b = StencilAlloc<Real>(n);
+    for (size_t k = 0; k < nz + 2; ++k)
+        for (size_t i = 0; i < nx + 2; ++i)
+            for (size_t j = 0; j < stride; ++j)
+                a[k * planeStride + i * stride + j] =
+                    b[k * planeStride + i * stride + j] =
+                        Real(j < ny + 2 ? initValue(k, i, j) : 0.0);
+    const StencilRange3D all = {1,
+                                ptrdiff_t(nz + 1),
+                                1,
+                                ptrdiff_t(nx + 1),
+                                1,
+                                ptrdiff_t(ny + 1)};
+    const std::vector<StencilRange3D> range(levels, all);
+    StencilRow3DFunc<Real> kernel = StencilRow3DKernel<Real>(isa);
+    Real *cur = a;
+    Real *next = b;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int s = 0; s < sweeps; s += levels)
+    {
+        const unsigned int l = std::min(levels, sweeps - s);
+        StencilWavefront3D(cur, next, stride, planeStride, range.data(), l,
+                           kernel, Real(omega));
+        if (l % 2)
+        {
+            std::swap(cur, next);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    maxdiff = 0.0;
+    for (size_t k = 1; k <= nz; ++k)
+        for (size_t i = 1; i <= nx; ++i)
+            for (size_t j = 1; j <= ny; ++j)
+                maxdiff = std::max(
+                    maxdiff,
+                    std::fabs(cur[k * planeStride + i * stride + j] -
+                              reference[((k - 1) * nx + i - 1) * ny + j - 1]));
+    StencilFree(a);
+    StencilFree(b);
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static void report(const std::string &name, double seconds, size_t nx,
+                   size_t ny, unsigned int sweeps, double maxdiff,
+                   size_t elementSize = sizeof(double),
+                   unsigned int flopsPerCell = 6)
+{
+    // one read and one write stream of the array per sweep, 6 flops per cell
+    // in 2D, 8 in 3D
+    const double cells = double(nx) * ny * sweeps;
+    std::cout << std::left << std::setw(20) << name << std::right
+              << std::fixed << std::setprecision(3) << std::setw(12)
+              << seconds / sweeps * 1e3 << std::setw(10)
+              << 2 * elementSize * cells / seconds / 1e9 << std::setw(10)
+              << flopsPerCell * cells / seconds / 1e9 << std::scientific
+              << std::setprecision(2) << std::setw(12) << maxdiff
+              << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        printUsage();
+        return 1;
+    }
+    const size_t nx = std::strtoul(argv[1], nullptr, 10);
+    const size_t ny = std::strtoul(argv[2], nullptr, 10);
+    const unsigned int sweeps = std::strtoul(argv[3], nullptr, 10);
+    const size_t nz = (argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 0);
+    if (!nx || !ny || !sweeps || (argc > 4 && !nz))
+    {
+        printUsage();
+        return 1;
+    }
+
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+
+    const StencilTile tile = StencilTileSize(nx, ny);
+    std::cout << "Array size : " << nx << " x " << ny << ", " << sweeps
+              << " sweeps, tile " << tile.rows << " x " << tile.cols
+              << std::endl;
+    std::cout << std::left << std::setw(20) << "kernel" << std::right
+              << std::setw(12) << "ms/sweep" << std::setw(10) << "GB/s"
+              << std::setw(10) << "GFLOP/s" << std::setw(12) << "max diff"
+              << std::endl;
+
+    std::vector<double> reference;
+    double t = runReference(nx, ny, sweeps, reference);
+    report("reference (double**)", t, nx, ny, sweeps, 0.0);
+
+    const StencilISA isas[] = {StencilISA::Scalar, StencilISA::AVX2,
+                               StencilISA::AVX512};
+    for (StencilISA isa : isas)
+    {
+        if (!StencilSupported(isa))
+        {
+            continue;
+        }
+        for (int variant = 0; variant < 3; ++variant)
+        {
+            const bool tiled = (variant > 0);
+            const bool withStats = (variant > 1);
+            double maxdiff;
+            t = runKernel<double>(nx, ny, sweeps, isa, tiled, withStats,
+                                  reference, maxdiff);
+            report(std::string(StencilISAName(isa)) +
+                       (tiled ? " tiled" : "") + (withStats ? " stats" : ""),
+                   t, nx, ny, sweeps, maxdiff);
+        }
+        // the max diff of float is its rounding error against double
+        for (int variant = 1; variant < 3; ++variant)
+        {
+            const bool withStats = (variant > 1);
+            double maxdiff;
+            t = runKernel<float>(nx, ny, sweeps, isa, true, withStats,
+                                 reference, maxdiff);
+            report(std::string(StencilISAName(isa)) + " float" +
+                       (withStats ? " stats" : ""),
+                   t, nx, ny, sweeps, maxdiff, sizeof(float));
+        }
+    }
+
+    if (!nz)
+    {
+        return 0;
+    }
+    std::cout << "Volume     : " << nz << " x " << nx << " x " << ny
+              << std::endl;
+    t = runReference3D(nx, ny, nz, sweeps, reference);
+    report("reference 3D", t, nz * nx, ny, sweeps, 0.0, sizeof(double), 8);
+    for (StencilISA isa : isas)
+    {
+        if (!StencilSupported(isa))
+        {
+            continue;
+        }
+        for (unsigned int levels : {1u, 4u})
+        {
+            const std::string name = std::string(StencilISAName(isa)) +
+                                     (levels > 1 ? " wave" : "");
+            double maxdiff;
+            t = runKernel3D<double>(nx, ny, nz, sweeps, isa, levels,
+                                    reference, maxdiff);
+            report(name + " 3D", t, nz * nx, ny, sweeps, maxdiff,
+                   sizeof(double), 8);
+            t = runKernel3D<float>(nx, ny, nz, sweeps, isa, levels,
+                                   reference, maxdiff);
+            report(name + " 3D float", t, nz * nx, ny, sweeps, maxdiff,
+                   sizeof(float), 8);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Distributed under the OSI-approved Apache License, Version 2.0.  See
+ * accompanying file Copyright.txt for details.
+ *
+ * topologyBenchmark.cpp
+ *
+ * Count the halo exchange messages of the heatSimulation process grid that
+ * cross node boundaries, for the default rank layout of Settings and for a
+ * grid created by MPI_Cart_create with rank reordering. Run it with the same
+ * number of processes and the same mpirun mapping as heatSimulation.
+ *
+ *  Created on: Oct 2026
+ */
+
+#include <mpi.h>
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void printUsage()
+{
+    std::cout << "Usage: heatTopologyBench  N  M  nx  ny  [options]\n"
+              << "  N:      number of processes in X dimension\n"
+              << "  M:      number of processes in Y dimension\n"
+              << "  nx:     local array size in X dimension per processor\n"
+              << "  ny:     local array size in Y dimension per processor\n"
+              << "Options:\n"
+              << "  --periodic:      periodic plate in both dimensions\n"
+              << "  --per-node k:    pretend that every k consecutive ranks "
+                 "share a node\n\n";
+}
+
+/* Node of every rank of comm: the lowest world rank on the same node,
+ * or world rank / perNode if perNode > 0
+ */
+static std::vector<int> nodeIds(MPI_Comm comm, int perNode)
+{
+    int wrank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &wrank);
+    int node = (perNode > 0 ? wrank / perNode : wrank);
+    if (perNode <= 0)
+    {
+        MPI_Comm nodeComm;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, wrank,
+                            MPI_INFO_NULL, &nodeComm);
+        MPI_Bcast(&node, 1, MPI_INT, 0, nodeComm);
+        MPI_Comm_free(&nodeComm);
+    }
+    int nproc;
+    MPI_Comm_size(comm, &nproc);
+    std::vector<int> nodes(nproc);
+    MPI_Allgather(&node, 1, MPI_INT, nodes.data(), 1, MPI_INT, comm);
+    return nodes;
+}
+
+struct Traffic
+{
+    long messages = 0;      // messages per exchange
+    long remote = 0;        // of those, sent to another node
+    double remoteBytes = 0; // bytes per exchange sent to another node
+};
+
+/* Messages this rank sends in one exchange to its neighbors
+ * (left, right, up, down; negative if there is none)
+ */
+static Traffic countTraffic(const int neighbors[4],
+                            const std::vector<int> &nodes, int rank,
+                            unsigned int nx, unsigned int ny, MPI_Comm comm)
+{
+    Traffic local;
+    for (int n = 0; n < 4; ++n)
+    {
+        if (neighbors[n] < 0)
+            continue;
+        ++local.messages;
+        if (nodes[neighbors[n]] != nodes[rank])
+        {
+            ++local.remote;
+            // columns to the left/right, rows up/down
+            local.remoteBytes += (n < 2 ? nx : ny) * sizeof(double);
+        }
+    }
+    Traffic total;
+    MPI_Allreduce(&local.messages, &total.messages, 1, MPI_LONG, MPI_SUM,
+                  comm);
+    MPI_Allreduce(&local.remote, &total.remote, 1, MPI_LONG, MPI_SUM, comm);
+    MPI_Allreduce(&local.remoteBytes, &total.remoteBytes, 1, MPI_DOUBLE,
+                  MPI_SUM, comm);
+    return total;
+}
+
+static void report(const std::string &name, const Traffic &t)
+{
+    std::cout << std::left << std::setw(12) << name << std::right
+              << std::setw(10) << t.messages << std::setw(12) << t.remote
+              << std::setw(14) << std::fixed << std::setprecision(1)
+              << t.remoteBytes / 1024 << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+    int rank, nproc;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+
+    bool periodic = false;
+    int perNode = 0;
+    bool valid = (argc >= 5);
+    for (int i = 5; valid && i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--periodic")
+            periodic = true;
+        else if (arg == "--per-node" && i + 1 < argc)
+            perNode = std::atoi(argv[++i]);
+        else
+            valid = false;
+    }
+    const int npx = valid ? std::atoi(argv[1]) : 0;
+    const int npy = valid ? std::atoi(argv[2]) : 0;
+    const unsigned int nx = valid ? std::atoi(argv[3]) : 0;
+    const unsigned int ny = valid ? std::atoi(argv[4]) : 0;
+    if (npx <= 0 || npy <= 0 || !nx || !ny || npx * npy != nproc)
+    {
+        if (!rank)
+        {
+            if (valid)
+                std::cout << "N*M must equal the number of processes\n";
+            printUsage();
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Default layout of Settings: X is the fast dimension of the ranks
+    const int posx = rank % npx;
+    const int posy = rank / npx;
+    int neighbors[4];
+    neighbors[0] = (posy > 0 ? rank - npx
+                             : (periodic ? rank + (npy - 1) * npx : -1));
+    neighbors[1] = (posy < npy - 1 ? rank + npx
+                                   : (periodic ? rank - (npy - 1) * npx : -1));
+    neighbors[2] = (posx > 0 ? rank - 1 : (periodic ? rank + npx - 1 : -1));
+    neighbors[3] =
+        (posx < npx - 1 ? rank + 1 : (periodic ? rank - npx + 1 : -1));
+    const std::vector<int> nodes = nodeIds(MPI_COMM_WORLD, perNode);
+    const Traffic byRank =
+        countTraffic(neighbors, nodes, rank, nx, ny, MPI_COMM_WORLD);
+
+    // The same grid from MPI_Cart_create, as heatSimulation --cart does it
+    int dims[2] = {npy, npx};
+    int periods[2] = {periodic, periodic};
+    MPI_Comm cartComm;
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &cartComm);
+    int crank;
+    MPI_Comm_rank(cartComm, &crank);
+    MPI_Cart_shift(cartComm, 0, 1, &neighbors[0], &neighbors[1]);
+    MPI_Cart_shift(cartComm, 1, 1, &neighbors[2], &neighbors[3]);
+    for (int &n : neighbors)
+    {
+        if (n == MPI_PROC_NULL)
+            n = -1;
+    }
+    const Traffic byCart = countTraffic(neighbors, nodeIds(cartComm, perNode),
+                                        crank, nx, ny, cartComm);
+
+    int nnodes = 0;
+    for (int r = 0; r < nproc; ++r)
+    {
+        bool first = true;
+        for (int q = 0; q < r && first; ++q)
+            first = (nodes[q] != nodes[r]);
+        nnodes += first;
+    }
+
+    if (!rank)
+    {
+        std::cout << "Process decomposition  : " << npx << " x " << npy
+                  << (periodic ? " periodic" : "") << " on " << nnodes
+                  << " node(s)" << std::endl;
+        std::cout << "Array size per process : " << nx << " x " << ny
+                  << std::endl;
+        std::cout << "Messages per exchange:\n"
+                  << std::left << std::setw(12) << "layout" << std::right
+                  << std::setw(10) << "total" << std::setw(12) << "inter-node"
+                  << std::setw(14) << "remote KB" << std::endl;
+        report("default", byRank);
+        report("cartesian", byCart);
+    }
+
+    MPI_Comm_free(&cartComm);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Distributed under the OSI-approved Apache License, Version 2.0.  See
+# accompanying file Copyright.txt for details.
+#
+# strongScaling.sh
+#
+# Strong scaling of heatSimulation on a fixed global array: the same cores
+# are used by pure MPI (one process per core) and by hybrid setups with
+# fewer processes and more OpenMP threads per process.
+#
+#  Created on: Oct 2026
+#
+
+if [ $# -lt 5 ]; then
+    echo "Usage: strongScaling.sh  cores  gnx  gny  steps  iterations  [threads...]"
+    echo "  cores:   number of cores to use"
+    echo "  gnx gny: global array size"
+    echo "  steps iterations: as for heatSimulation"
+    echo "  threads: threads per process to compare (default: 1 2 4 8)"
+    echo "Set MPIRUN to change the launcher (default: mpirun), and"
+    echo "HEAT_OPTIONS for more heatSimulation options."
+    exit 1
+fi
+
+cores=$1
+gnx=$2
+gny=$3
+steps=$4
+iterations=$5
+shift 5
+threads=${*:-1 2 4 8}
+mpirun=${MPIRUN:-mpirun}
+
+printf "%8s %8s %10s %12s %12s\n" processes threads grid "compute [s]" "total [s]"
+for t in $threads; do
+    np=$((cores / t))
+    if [ $np -lt 1 ] || [ $((np * t)) -ne $cores ]; then
+        continue
+    fi
+    # the most square process grid that divides the array
+    n=1
+    i=1
+    while [ $((i * i)) -le $np ]; do
+        if [ $((np % i)) -eq 0 ] && [ $((gnx % i)) -eq 0 ] &&
+            [ $((gny % (np / i))) -eq 0 ]; then
+            n=$i
+        fi
+        i=$((i + 1))
+    done
+    m=$((np / n))
+    if [ $((gnx % n)) -ne 0 ] || [ $((gny % m)) -ne 0 ]; then
+        echo "cannot divide $gnx x $gny over $np processes"
+        continue
+    fi
+    out=$($mpirun -n $np ./heatSimulation scaling.bp $n $m \
+        $((gnx / n)) $((gny / m)) $steps $iterations --threads $t --pin \
+        $HEAT_OPTIONS)
+    compute=$(echo "$out" | sed -n 's/^Computation and exchange = \(.*\)s$/\1/p')
+    total=$(echo "$out" | sed -n 's/^Total runtime = \(.*\)s$/\1/p')
+    printf "%8d %8d %10s %12s %12s\n" $np $t "${n}x${m}" "$compute" "$total"
+done
@@ -15,7 +15,9 @@
 
 #include "VizSettings.h"
 
-void OutputVariable(const adios2::Variable<double> &var,
+// Output data, the values of var (double or float) converted to double
+template <class T>
+void OutputVariable(const adios2::Variable<T> &var,
                     const std::vector<double> &data, VizSettings &settings,
                     const int step);
 
@@ -17,7 +17,8 @@
 
 #include "VizOutput.h"
 
-void OutputVariable(const adios2::Variable<double> &var,
+template <class T>
+void OutputVariable(const adios2::Variable<T> &var,
                     const std::vector<double> &data, VizSettings &settings,
                     const int step)
 {
@@ -59,3 +60,10 @@ void OutputVariable(const adios2::Variable<double> &var,
     buf += nelems;
     myfile.close();
 }
+
+template void OutputVariable(const adios2::Variable<double> &var,
+                             const std::vector<double> &data,
+                             VizSettings &settings, const int step);
+template void OutputVariable(const adios2::Variable<float> &var,
+                             const std::vector<double> &data,
+                             VizSettings &settings, const int step);
@@ -72,7 +72,8 @@ void Render2D(const vtkm::cont::DataSet &ds, const std::string &fieldNm,
     view.SaveAs(settings.outputfile);
 }
 
-bool RenderVariable2D(const adios2::Variable<double> &var, const void *buff,
+template <class T>
+bool RenderVariable2D(const adios2::Variable<T> &var, const void *buff,
                       const VizSettings &settings)
 {
 
@@ -112,10 +113,18 @@ bool RenderVariable2D(const adios2::Variable<double> &var, const void *buff,
     return true;
 }
 
-void OutputVariable(const adios2::Variable<double> &var,
+template <class T>
+void OutputVariable(const adios2::Variable<T> &var,
                     const std::vector<double> &data, VizSettings &settings,
                     const int step)
 {
     settings.outputfile = var.Name() + "." + std::to_string(step) + ".pnm";
     RenderVariable2D(var, data.data(), settings);
 }
+
+template void OutputVariable(const adios2::Variable<double> &var,
+                             const std::vector<double> &data,
+                             VizSettings &settings, const int step);
+template void OutputVariable(const adios2::Variable<float> &var,
+                             const std::vector<double> &data,
+                             VizSettings &settings, const int step);
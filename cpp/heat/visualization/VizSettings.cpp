@@ -50,6 +50,17 @@ static unsigned int convertToUint(std::string varName, char *arg)
     return (unsigned int)retval;
 }
 
+// value of the optional argument argv[i], moving i to it
+static char *optionValue(int argc, char *argv[], int &i)
+{
+    if (i + 1 >= argc)
+    {
+        throw std::invalid_argument("Missing value for " +
+                                    std::string(argv[i]));
+    }
+    return argv[++i];
+}
+
 VizSettings::VizSettings(int argc, char *argv[])
 {
     if (argc < 2)
@@ -59,20 +70,40 @@ VizSettings::VizSettings(int argc, char *argv[])
 
     //configfile = argv[1];
     inputfile = argv[1];
-    if (argc > 2)
-    {
-        minValue = convertToDouble("min", argv[2]);
-    }
-    if (argc > 3)
+    // the optional arguments in order, up to the first --option
+    int i = 2;
+    for (; i < argc && std::string(argv[i]).compare(0, 2, "--"); ++i)
     {
-        maxValue = convertToDouble("max", argv[3]);
+        if (i == 2)
+            minValue = convertToDouble("min", argv[i]);
+        else if (i == 3)
+            maxValue = convertToDouble("max", argv[i]);
+        else if (i == 4)
+            width = convertToUint("width", argv[i]);
+        else if (i == 5)
+            height = convertToUint("height", argv[i]);
+        else
+            throw std::invalid_argument("Too many arguments");
     }
-    if (argc > 4)
+
+    for (; i < argc; ++i)
     {
-        width = convertToUint("width", argv[4]);
+        const std::string arg(argv[i]);
+        if (arg == "--step-timeout")
+        {
+            stepTimeout = convertToDouble(arg, optionValue(argc, argv, i));
+        }
+        else if (arg == "--backoff-max")
+        {
+            backoffMax = convertToUint(arg, optionValue(argc, argv, i));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
     }
-    if (argc > 5)
+    if (backoffMax < 1)
     {
-        height = convertToUint("height", argv[5]);
+        throw std::invalid_argument("--backoff-max must be at least 1");
     }
 }
@@ -31,6 +31,10 @@ public:
     unsigned int width = 512;  
     unsigned int height = 512; 
 
+    // Waiting for steps
+    double stepTimeout = -1.0;     // seconds to wait for a step, < 0: ever
+    unsigned int backoffMax = 100; // longest pause between polls in ms
+
 
     /* App settings */
 
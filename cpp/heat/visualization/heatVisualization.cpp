@@ -6,6 +6,7 @@
 
 #include "adios2.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
@@ -14,22 +15,27 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
-#include <chrono>
-#include <thread>
 #include <numeric>
 
+#include "StepWaiter.h"
 #include "VizOutput.h"
 #include "VizSettings.h"
 
 void printUsage()
 {
-    std::cout << "Usage: heatVisualization  input [ min  max  width  height ]\n"
+    std::cout << "Usage: heatVisualization  input [ min  max  width  height ] "
+                 "[options]\n"
               << "  input  : name of input data file/stream\n"
               << "  Optional arguments\n"
               << "  min    : lowest value for the colortable\n"
               << "  max    : highest value for the colortable\n"
               << "  height : output image width in pixels\n"
-              << "  width  : output image height in pixels\n\n";
+              << "  width  : output image height in pixels\n"
+              << "  Options\n"
+              << "  --step-timeout s  stop if no step arrives in s seconds "
+                 "(default: wait forever)\n"
+              << "  --backoff-max ms  longest pause between polls for a step "
+                 "(at least 1, default 100)\n\n";
 }
 
 int main(int argc, char *argv[])
@@ -77,22 +83,23 @@ int main(int argc, char *argv[])
                 settings.inputfile, adios2::Mode::Read, MPI_COMM_SELF);
 
             std::vector<double> Tin;
+            std::vector<float> TinFloat; // T of --precision float
             adios2::Variable<double> vTin;
+            adios2::Variable<float> vTinFloat;
+            StepWaiter waiter(settings.stepTimeout, settings.backoffMax,
+                              MPI_COMM_SELF);
             bool firstStep = true;
             int step = 0;
 
             while (true)
             {
-                adios2::StepStatus status =
-                    reader.BeginStep(adios2::StepMode::NextAvailable, 10.0f);
+                const adios2::StepStatus status = waiter.beginStep(reader);
                 if (status == adios2::StepStatus::NotReady)
                 {
-                    // std::cout << "Stream not ready yet. Waiting...\n";
-                    std::this_thread::sleep_for(
-                        std::chrono::milliseconds(1000));
-                    continue;
+                    std::cout << "No step within " << settings.stepTimeout
+                              << "s, stopping" << std::endl;
                 }
-                else if (status != adios2::StepStatus::OK)
+                if (status != adios2::StepStatus::OK)
                 {
                     break;
                 }
@@ -101,18 +108,27 @@ int main(int argc, char *argv[])
                 // every
                 // step
                 vTin = inIO.InquireVariable<double>("T");
+                if (!vTin)
+                {
+                    vTinFloat = inIO.InquireVariable<float>("T");
+                    if (!vTinFloat)
+                    {
+                        throw std::runtime_error("No variable T in " +
+                                                 settings.inputfile);
+                    }
+                }
+                const adios2::Dims shape =
+                    (vTin ? vTin.Shape() : vTinFloat.Shape());
 
                 if (firstStep)
                 {
-                    size_t gndx = vTin.Shape()[0];
-                    size_t gndy = vTin.Shape()[1];
+                    size_t gndx = shape[0];
+                    size_t gndy = shape[1];
 
                     if (rank == 0)
                     {
-                        std::cout << "gndx       = " << vTin.Shape()[0]
-                                  << std::endl;
-                        std::cout << "gndy       = " << vTin.Shape()[1]
-                                  << std::endl;
+                        std::cout << "gndx       = " << shape[0] << std::endl;
+                        std::cout << "gndy       = " << shape[1] << std::endl;
                     }
                     //Tin.resize(std::accumulate(vTin.Count().begin(), vTin.Count().end(), vTin.Sizeof(), std::multiplies<size_t>()));
                     Tin.resize(gndx*gndy);
@@ -120,9 +136,18 @@ int main(int argc, char *argv[])
                 }
 
                 // Create a 2D selection for the subset
-                vTin.SetSelection(
-                    adios2::Box<adios2::Dims>({0, 0}, vTin.Shape()));
-                reader.Get<double>(vTin, Tin.data());
+                if (vTin)
+                {
+                    vTin.SetSelection(adios2::Box<adios2::Dims>({0, 0}, shape));
+                    reader.Get<double>(vTin, Tin.data());
+                }
+                else
+                {
+                    TinFloat.resize(Tin.size());
+                    vTinFloat.SetSelection(
+                        adios2::Box<adios2::Dims>({0, 0}, shape));
+                    reader.Get<float>(vTinFloat, TinFloat.data());
+                }
 
                 if (firstStep)
                 {
@@ -130,24 +155,37 @@ int main(int argc, char *argv[])
                 }
 
                 reader.EndStep();
+                if (!vTin)
+                {
+                    std::copy(TinFloat.begin(), TinFloat.end(), Tin.begin());
+                }
 
                 std::cout << "Visualization step " << step
                           << " processing analysis step "
                           << reader.CurrentStep() << std::endl;
 
                 /* Plot or print T */
-                OutputVariable(vTin, Tin, settings, reader.CurrentStep());
+                if (vTin)
+                    OutputVariable(vTin, Tin, settings, reader.CurrentStep());
+                else
+                    OutputVariable(vTinFloat, Tin, settings,
+                                   reader.CurrentStep());
 
                 step++;
                 firstStep = false;
             }
             reader.Close();
+            waiter.print(std::cout);
         }
         catch (std::invalid_argument &e) // command-line argument errors
         {
             std::cout << e.what() << std::endl;
             printUsage();
         }
+        catch (std::runtime_error &e) // errors of the input
+        {
+            std::cout << e.what() << std::endl;
+        }
     }
 
     MPI_Barrier(mpiVizComm);